@@ -51,6 +51,11 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ/WRITE SECTOR command can transfer.  The
+   sector count register is 8 bits wide (0 means 256, which we do
+   not use). */
+#define MAX_SECTORS_PER_CMD 255
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -86,7 +91,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -348,7 +353,7 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
     lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
@@ -368,7 +373,7 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
     lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -377,24 +382,99 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
     lock_release (&c->lock);
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   issuing one READ SECTOR command per MAX_SECTORS_PER_CMD
+   sectors rather than one per sector.  The disk still interrupts
+   once per sector in PIO mode.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t i;
+
+      select_sector (d, sec_no, chunk);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < chunk; i++)
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+                   sec_no + i);
+          input_sector (c, p);
+          p += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER
+   with one WRITE SECTOR command per MAX_SECTORS_PER_CMD sectors.
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t i;
+
+      select_sector (d, sec_no, chunk);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (i = 0; i < chunk; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+                   sec_no + i);
+          output_sector (c, p);
+          sema_down (&c->completion_wait);
+          p += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -37,6 +37,9 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_FIFO 0x07           /* Enable and clear both FIFOs. */
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -47,6 +50,10 @@
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
+
+/* Bytes the transmit FIFO holds.  With the FIFO enabled, LSR_THRE
+   means that all of them are free. */
+#define XMIT_FIFO_SIZE 16
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
@@ -56,6 +63,8 @@ static struct intq txq;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void putbuf_poll (const uint8_t *, size_t);
+static void fill_fifo (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,7 +77,7 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_FIFO);             /* Enable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
@@ -129,6 +138,51 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUF to the serial port.  Unlike calling
+   serial_putc() for each byte, this disables interrupts only
+   once, and before interrupt-driven I/O is set up it fills the
+   transmit FIFO at a time instead of polling before every
+   byte. */
+void
+serial_putbuf (const uint8_t *buf, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      putbuf_poll (buf, n);
+    }
+  else 
+    {
+      while (n-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* As in serial_putc(), send by polling rather
+                     than reenable interrupts. */
+                  while ((inb (LSR_REG) & LSR_THRE) == 0)
+                    continue;
+                  fill_fifo ();
+                }
+              else
+                {
+                  /* intq_putc() will wait for the transmit
+                     interrupt to make room. */
+                  write_ier ();
+                }
+            }
+          intq_putc (&txq, *buf++);
+        }
+      write_ier ();
+    }
+  
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -136,7 +190,11 @@ serial_flush (void)
 {
   enum intr_level old_level = intr_disable ();
   while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+    {
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      fill_fifo ();
+    }
   intr_set_level (old_level);
 }
 
@@ -205,6 +263,37 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Polls the serial port until its transmit FIFO is empty, then
+   refills it from the N bytes in BUF, until BUF is sent. */
+static void
+putbuf_poll (const uint8_t *buf, size_t n)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (n > 0)
+    {
+      size_t i;
+
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      for (i = 0; i < XMIT_FIFO_SIZE && n > 0; i++, n--)
+        outb (THR_REG, *buf++);
+    }
+}
+
+/* Moves up to a FIFO's worth of bytes from TXQ into the UART,
+   whose transmit FIFO must be empty. */
+static void
+fill_fifo (void)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < XMIT_FIFO_SIZE && !intq_empty (&txq); i++)
+    outb (THR_REG, intq_getc (&txq));
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +307,10 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the hardware is ready to accept bytes for transmission,
+     fill its FIFO with as many as we have. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0) 
+    fill_fifo ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
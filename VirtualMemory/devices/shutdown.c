@@ -13,6 +13,11 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -122,6 +127,11 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
+  swap_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
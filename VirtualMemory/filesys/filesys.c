@@ -6,10 +6,16 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/synch.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Serializes directory operations: lookups, and the changes
+   made by creating and removing files.  File data is protected
+   per inode instead; see inode.c. */
+static struct semaphore dir_lock;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,6 +27,7 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  sema_init (&dir_lock, 1);
   inode_init ();
   free_map_init ();
 
@@ -36,6 +43,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  inode_flush_all ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,14 +54,19 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  sema_down (&dir_lock);
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  sema_up (&dir_lock);
 
   return success;
 }
@@ -66,12 +79,15 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  sema_down (&dir_lock);
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
+  sema_up (&dir_lock);
 
   return file_open (inode);
 }
@@ -83,9 +99,14 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  sema_down (&dir_lock);
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  sema_up (&dir_lock);
 
   return success;
 }
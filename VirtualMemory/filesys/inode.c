@@ -6,6 +6,10 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -37,31 +41,103 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct list cache_pages;            /* Cached pages of data. */
+
+    /* Reader/writer lock over the inode's data and
+       deny_write_cnt.  RW_LOCK is held by one writer, or by the
+       current readers as a group.  Writers hold TURNSTILE while
+       they wait for RW_LOCK and readers pass through it on the way
+       in, so a waiting writer holds back newly arriving readers
+       instead of starving behind them. */
+    struct semaphore rw_lock;
+    struct semaphore turnstile;
+    struct semaphore readers_lock;      /* Protects READERS. */
+    int readers;                        /* Readers holding RW_LOCK. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
-{
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
-}
+/* File page cache.
+
+   File data is cached a page at a time in kernel pages, so that
+   reads and writes of recently used parts of files do not touch
+   the disk.  This includes the reads behind executable and mmap
+   page faults and the writes behind mmap write-back, which go
+   through inode_read_at and inode_write_at like everything else.
+   Dirty pages are written back when they are evicted and when
+   their inode is closed for the last time.
+
+   A page of a file that processes have mapped is cached in the
+   frame they share instead, which the VM registers with
+   inode_map_page while the frame holds it.  Reads and writes of
+   such a page then go to the mapped memory itself, so they see
+   and are seen by the mapping at once, and the page is held only
+   once. */
+#define CACHE_PAGES 32
+#define CACHE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+struct cache_page
+  {
+    struct list_elem elem;              /* Element in inode's cache_pages. */
+    struct inode *inode;                /* Owner, or null if unused. */
+    off_t index;                        /* Page number within the file. */
+    uint8_t *data;                      /* Cached data. */
+    bool mapped;                        /* DATA is a mapped file frame? */
+    bool dirty;                         /* Modified since read from disk? */
+    bool accessed;                      /* Used since the hand passed? */
+    bool loading;                       /* Being read from disk? */
+    int pin_cnt;                        /* Copies into or out of DATA. */
+    int waiters;                        /* Threads blocked on READY. */
+    struct semaphore ready;             /* Loading done or pin dropped. */
+  };
+
+static struct cache_page cache[CACHE_PAGES];
+static size_t cache_cnt;                /* Entries of CACHE in use. */
+static size_t cache_hand;               /* Clock hand for eviction. */
+
+/* Protects the cache and every inode's cache_pages.  Not held
+   while data is copied to or from the caller, which may fault,
+   nor while a page is read from or written to disk. */
+static struct semaphore cache_lock;
+
+static struct cache_page *cache_get (struct inode *, off_t index, bool fill);
+static void cache_put (struct cache_page *, bool dirty);
+static void cache_flush (struct inode *, bool drop);
+static struct cache_page *cache_lookup (struct inode *, off_t index);
+static void cache_wait (struct cache_page *);
+static void cache_unpin (struct cache_page *);
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and every inode's open_cnt. */
+static struct semaphore open_inodes_lock;
+
+static void inode_read_lock (struct inode *);
+static void inode_read_unlock (struct inode *);
+static void inode_write_lock (struct inode *);
+static void inode_write_unlock (struct inode *);
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  sema_init (&open_inodes_lock, 1);
+
+  sema_init (&cache_lock, 1);
+  for (cache_cnt = 0; cache_cnt < CACHE_PAGES; cache_cnt++)
+    {
+      cache[cache_cnt].data = palloc_get_page (0);
+      if (cache[cache_cnt].data == NULL)
+        break;
+      cache[cache_cnt].inode = NULL;
+      cache[cache_cnt].mapped = false;
+      cache[cache_cnt].waiters = 0;
+      sema_init (&cache[cache_cnt].ready, 0);
+    }
+  if (cache_cnt == 0)
+    PANIC ("inode_init: cannot allocate file page cache");
+  cache_hand = 0;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -115,13 +191,15 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  sema_down (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          sema_up (&open_inodes_lock);
           return inode; 
         }
     }
@@ -129,15 +207,25 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      sema_up (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  The inode is read before the lock is released,
+     so that other openers never see it half filled in. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  list_init (&inode->cache_pages);
+  sema_init (&inode->rw_lock, 1);
+  sema_init (&inode->turnstile, 1);
+  sema_init (&inode->readers_lock, 1);
+  inode->readers = 0;
   block_read (fs_device, inode->sector, &inode->data);
+  sema_up (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +234,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      sema_down (&open_inodes_lock);
+      inode->open_cnt++;
+      sema_up (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -167,22 +259,31 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Release resources if this was the last opener.  The cached
+     data is written back before INODE leaves the list, so that an
+     opener of the same sector waits for it instead of reading
+     stale data from disk. */
+  sema_down (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      sema_up (&open_inodes_lock);
+      return;
+    }
+
+  /* Write back cached data, unless it is about to be freed. */
+  cache_flush (inode, true);
+  list_remove (&inode->elem);
+  sema_up (&open_inodes_lock);
 
-      free (inode); 
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      free_map_release (inode->sector, 1);
+      free_map_release (inode->data.start,
+                        bytes_to_sectors (inode->data.length)); 
     }
+
+  free (inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -202,49 +303,35 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  inode_read_lock (inode);
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      /* Cached page to read, starting byte offset within page. */
+      off_t index = offset / PGSIZE;
+      int page_ofs = offset % PGSIZE;
+      struct cache_page *c;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
 
-      /* Number of bytes to actually copy out of this sector. */
+      /* Number of bytes to actually copy out of this page. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      c = cache_get (inode, index, true);
+      memcpy (buffer + bytes_read, c->data + page_ofs, chunk_size);
+      cache_put (c, false);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  inode_read_unlock (inode);
 
   return bytes_read;
 }
@@ -260,59 +347,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  inode_write_lock (inode);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      inode_write_unlock (inode);
+      return 0;
+    }
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      /* Cached page to write, starting byte offset within page. */
+      off_t index = offset / PGSIZE;
+      int page_ofs = offset % PGSIZE;
+      struct cache_page *c;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
 
-      /* Number of bytes to actually write into this sector. */
+      /* Number of bytes to actually write into this page. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* If the page contains data before or after the chunk
+         we're writing, then we need to read in the page first.
+         Writing back a mapped page copies it onto itself. */
+      c = cache_get (inode, index, page_ofs > 0 || chunk_size < min_left);
+      memmove (c->data + page_ofs, buffer + bytes_written, chunk_size);
+      cache_put (c, true);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  inode_write_unlock (inode);
 
   return bytes_written;
 }
@@ -322,8 +394,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  inode_write_lock (inode);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  inode_write_unlock (inode);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +406,54 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  inode_write_lock (inode);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  inode_write_unlock (inode);
+}
+
+/* Acquires INODE's reader/writer lock for reading.  Any number
+   of readers may hold it at once; the first one in takes RW_LOCK
+   on behalf of all of them and the last one out releases it.
+   Waits first for any writer already queued for the lock. */
+static void
+inode_read_lock (struct inode *inode)
+{
+  sema_down (&inode->turnstile);
+  sema_up (&inode->turnstile);
+  sema_down (&inode->readers_lock);
+  if (inode->readers++ == 0)
+    sema_down (&inode->rw_lock);
+  sema_up (&inode->readers_lock);
+}
+
+/* Releases INODE's reader/writer lock, held for reading. */
+static void
+inode_read_unlock (struct inode *inode)
+{
+  sema_down (&inode->readers_lock);
+  if (--inode->readers == 0)
+    sema_up (&inode->rw_lock);
+  sema_up (&inode->readers_lock);
+}
+
+/* Acquires INODE's reader/writer lock for writing.  Holding
+   TURNSTILE while waiting keeps new readers out until the
+   current ones have drained. */
+static void
+inode_write_lock (struct inode *inode)
+{
+  sema_down (&inode->turnstile);
+  sema_down (&inode->rw_lock);
+  sema_up (&inode->turnstile);
+}
+
+/* Releases INODE's reader/writer lock, held for writing. */
+static void
+inode_write_unlock (struct inode *inode)
+{
+  sema_up (&inode->rw_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +462,337 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Writes back the cached data of every open inode. */
+void
+inode_flush_all (void)
+{
+  struct list_elem *e;
+
+  sema_down (&open_inodes_lock);
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    cache_flush (list_entry (e, struct inode, elem), false);
+  sema_up (&open_inodes_lock);
+}
+
+/* Returns the number of sectors of INODE's data that page INDEX
+   covers. */
+static size_t
+cache_page_sectors (const struct inode *inode, off_t index)
+{
+  size_t sectors = bytes_to_sectors (inode->data.length);
+  size_t first = index * CACHE_SECTORS;
+
+  if (first >= sectors)
+    return 0;
+  return sectors - first < CACHE_SECTORS ? sectors - first : CACHE_SECTORS;
+}
+
+/* Writes cached page C to disk.  The caller must have C pinned
+   or hold cache_lock. */
+static void
+cache_write_back (struct cache_page *c)
+{
+  size_t sectors = cache_page_sectors (c->inode, c->index);
+
+  if (!c->inode->removed && sectors > 0)
+    block_write_multiple (fs_device, c->inode->data.start + c->index * CACHE_SECTORS,
+                          sectors, c->data);
+}
+
+/* Writes dirty cached page C back to disk with cache_lock
+   released, so that other pages and files can be looked up
+   meanwhile.  C stays pinned, and so cached and readable, during
+   the write.  A write to C that races with it marks C dirty
+   again.  The caller must hold cache_lock. */
+static void
+cache_clean (struct cache_page *c)
+{
+  c->dirty = false;
+  c->pin_cnt++;
+  sema_up (&cache_lock);
+  cache_write_back (c);
+  sema_down (&cache_lock);
+  cache_unpin (c);
+}
+
+/* Returns the cached page INDEX of INODE, or a null pointer if it
+   is not cached.  The caller must hold cache_lock. */
+static struct cache_page *
+cache_lookup (struct inode *inode, off_t index)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->cache_pages);
+       e != list_end (&inode->cache_pages); e = list_next (e))
+    {
+      struct cache_page *c = list_entry (e, struct cache_page, elem);
+      if (c->index == index)
+        return c;
+    }
+  return NULL;
+}
+
+/* Blocks until C has been loaded or lost a pin, releasing
+   cache_lock meanwhile.  The caller must hold cache_lock, and
+   must check again what it was waiting for. */
+static void
+cache_wait (struct cache_page *c)
+{
+  c->waiters++;
+  sema_up (&cache_lock);
+  sema_down (&c->ready);
+  sema_down (&cache_lock);
+}
+
+/* Wakes the threads waiting on C.  The caller must hold
+   cache_lock. */
+static void
+cache_wake (struct cache_page *c)
+{
+  for (; c->waiters > 0; c->waiters--)
+    sema_up (&c->ready);
+}
+
+/* Drops a pin from C.  The caller must hold cache_lock. */
+static void
+cache_unpin (struct cache_page *c)
+{
+  ASSERT (c->pin_cnt > 0);
+  if (--c->pin_cnt == 0)
+    cache_wake (c);
+}
+
+/* Picks a page of the cache to reuse with the clock, giving
+   recently used pages a second chance, and returns it, unlinked
+   from its inode.  Returns a null pointer instead after writing
+   back a dirty page, or after letting other threads run if every
+   page is in use; cache_lock is released meanwhile, so the
+   caller must look up its page again.  The caller must hold
+   cache_lock. */
+static struct cache_page *
+cache_victim (void)
+{
+  size_t scanned;
+
+  for (scanned = 0; scanned < 2 * cache_cnt; scanned++)
+    {
+      struct cache_page *c = &cache[cache_hand];
+      cache_hand = (cache_hand + 1) % cache_cnt;
+
+      if (c->inode == NULL)
+        return c;
+      if (c->pin_cnt > 0)
+        continue;
+      if (c->accessed)
+        {
+          c->accessed = false;
+          continue;
+        }
+      if (c->dirty)
+        {
+          cache_clean (c);
+          return NULL;
+        }
+      list_remove (&c->elem);
+      c->inode = NULL;
+      return c;
+    }
+
+  /* Every page is being copied; let the copies finish. */
+  sema_up (&cache_lock);
+  thread_yield ();
+  sema_down (&cache_lock);
+  return NULL;
+}
+
+/* Returns the cached page INDEX of INODE, reading it from disk if
+   it is not cached and FILL is true, or zeroing it otherwise.  The
+   page stays in the cache until it is released with cache_put. */
+static struct cache_page *
+cache_get (struct inode *inode, off_t index, bool fill)
+{
+  struct cache_page *c;
+
+  sema_down (&cache_lock);
+  for (;;)
+    {
+      c = cache_lookup (inode, index);
+      if (c != NULL)
+        {
+          c->accessed = true;
+          c->pin_cnt++;
+          while (c->loading)
+            cache_wait (c);     /* Another thread is reading it in. */
+          sema_up (&cache_lock);
+          return c;
+        }
+
+      c = cache_victim ();
+      if (c != NULL)
+        break;
+    }
+
+  c->inode = inode;
+  c->index = index;
+  c->dirty = false;
+  c->accessed = true;
+  c->pin_cnt = 1;
+  c->loading = true;
+  list_push_back (&inode->cache_pages, &c->elem);
+  sema_up (&cache_lock);
+
+  /* Fill the page without the lock, so that reads of other pages
+     and files go on meanwhile. */
+  size_t sectors = fill ? cache_page_sectors (inode, index) : 0;
+  if (sectors > 0)
+    block_read_multiple (fs_device, inode->data.start + index * CACHE_SECTORS,
+                         sectors, c->data);
+  memset (c->data + sectors * BLOCK_SECTOR_SIZE, 0,
+          PGSIZE - sectors * BLOCK_SECTOR_SIZE);
+
+  sema_down (&cache_lock);
+  c->loading = false;
+  cache_wake (c);
+  sema_up (&cache_lock);
+  return c;
+}
+
+/* Releases cached page C, obtained from cache_get, marking it
+   dirty if DIRTY is true. */
+static void
+cache_put (struct cache_page *c, bool dirty)
+{
+  sema_down (&cache_lock);
+  if (dirty)
+    c->dirty = true;
+  cache_unpin (c);
+  sema_up (&cache_lock);
+}
+
+/* Writes back INODE's dirty cached pages and, if DROP is true,
+   removes them from the cache. */
+static void
+cache_flush (struct inode *inode, bool drop)
+{
+  struct list_elem *e;
+
+  sema_down (&cache_lock);
+  e = list_begin (&inode->cache_pages);
+  while (e != list_end (&inode->cache_pages))
+    {
+      struct cache_page *c = list_entry (e, struct cache_page, elem);
+
+      if (c->dirty)
+        {
+          /* The list may change while C is written; C stays on it,
+             so start over from the front. */
+          cache_clean (c);
+          e = list_begin (&inode->cache_pages);
+        }
+      else
+        e = list_next (e);
+    }
+
+  while (drop && !list_empty (&inode->cache_pages))
+    {
+      struct cache_page *c = list_entry (list_front (&inode->cache_pages),
+                                         struct cache_page, elem);
+
+      /* Only an eviction writing it back can still hold it. */
+      if (c->pin_cnt > 0)
+        {
+          cache_wait (c);
+          continue;
+        }
+      list_remove (&c->elem);
+      if (c->mapped)
+        free (c);
+      else
+        c->inode = NULL;
+    }
+  sema_up (&cache_lock);
+}
+
+/* Makes KPAGE, a frame that holds page INDEX of INODE for the
+   processes mapping the file, INODE's cached copy of that page.
+   If the page was already cached, its contents, which may be
+   newer than KPAGE's, are moved into KPAGE and the cache page is
+   freed.  Returns false, leaving KPAGE out of the cache, if
+   memory is short or the page is already mapped elsewhere. */
+bool
+inode_map_page (struct inode *inode, off_t index, void *kpage)
+{
+  struct cache_page *m = malloc (sizeof *m);
+  struct cache_page *c;
+
+  if (m == NULL)
+    return false;
+  m->inode = inode;
+  m->index = index;
+  m->data = kpage;
+  m->mapped = true;
+  m->dirty = false;
+  m->accessed = true;
+  m->loading = false;
+  m->pin_cnt = 0;
+  m->waiters = 0;
+  sema_init (&m->ready, 0);
+
+  sema_down (&cache_lock);
+  c = cache_lookup (inode, index);
+  if (c != NULL)
+    {
+      if (c->mapped)
+        {
+          sema_up (&cache_lock);
+          free (m);
+          return false;
+        }
+
+      /* Wait for copies out of C to finish; pinned, C stays. */
+      c->pin_cnt++;
+      while (c->loading || c->pin_cnt > 1)
+        cache_wait (c);
+      memcpy (kpage, c->data, PGSIZE);
+      m->dirty = c->dirty;
+      list_remove (&c->elem);
+      c->inode = NULL;
+      c->pin_cnt = 0;
+    }
+  list_push_back (&inode->cache_pages, &m->elem);
+  sema_up (&cache_lock);
+  return true;
+}
+
+/* Takes KPAGE, registered with inode_map_page as INODE's cached
+   copy of page INDEX, back out of the cache before the frame is
+   reused.  Writes that reached it through the file rather than
+   through a mapping are written to disk first. */
+void
+inode_unmap_page (struct inode *inode, off_t index, void *kpage)
+{
+  struct cache_page *m;
+
+  sema_down (&cache_lock);
+  m = cache_lookup (inode, index);
+  if (m == NULL || m->data != kpage)
+    {
+      sema_up (&cache_lock);
+      return;
+    }
+
+  for (;;)
+    {
+      if (m->pin_cnt > 0)
+        cache_wait (m);
+      else if (m->dirty)
+        cache_clean (m);
+      else
+        break;
+    }
+  list_remove (&m->elem);
+  sema_up (&cache_lock);
+  free (m);
+}
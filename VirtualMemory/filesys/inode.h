@@ -19,5 +19,8 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_flush_all (void);
+bool inode_map_page (struct inode *, off_t index, void *kpage);
+void inode_unmap_page (struct inode *, off_t index, void *kpage);
 
 #endif /* filesys/inode.h */
@@ -28,7 +28,18 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_MSYNC,                  /* Write a memory mapping back to its file. */
+    SYS_MMAP_ANON,              /* Map zero-filled memory. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_VMSTAT,                 /* Get virtual memory statistics. */
+    SYS_RSSLIMIT,               /* Limit the resident set size. */
+    SYS_READV,                  /* Read a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_PREAD,                  /* Read a file at a given offset. */
+    SYS_PWRITE                  /* Write a file at a given offset. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -2,6 +2,8 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -15,6 +17,32 @@ typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 #endif
 
+/* Flags for msync(). */
+#define MS_ASYNC 1              /* Schedule the writes and return. */
+#define MS_SYNC 4               /* Write and wait for completion. */
+
+/* Virtual memory statistics of a process, filled in by vmstat(). */
+struct vmstat
+  {
+    unsigned minor_faults;      /* Faults served without I/O. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned writebacks;        /* Dirty mapped pages written to files. */
+    unsigned resident;          /* Pages in memory now. */
+    unsigned pinned;            /* Pages pinned in memory now. */
+  };
+
+/* One buffer of a readv() or writev() call. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Length of the buffer in bytes. */
+  };
+
+/* Maximum number of buffers in one readv() or writev() call. */
+#define IOV_MAX 32
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -41,6 +69,17 @@ void close (int fd);
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
 
+/* Extensions. */
+int msync (mapid_t, int flags);
+mapid_t mmap_anon (void *addr, size_t length);
+void *sbrk (intptr_t increment);
+bool vmstat (struct vmstat *);
+size_t rsslimit (size_t page_cnt);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+
 /* Project 4 only. */
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
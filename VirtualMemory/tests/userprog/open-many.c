@@ -0,0 +1,29 @@
+/* Opens the same file many times, past the size of a new fd
+   table, and checks that each open gets the lowest free fd,
+   including one freed by close in the middle of the table. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HANDLE_CNT 100
+
+void
+test_main (void) 
+{
+  int handles[HANDLE_CNT];
+  int i;
+
+  for (i = 0; i < HANDLE_CNT; i++)
+    {
+      handles[i] = open ("sample.txt");
+      if (handles[i] != i + 2)
+        fail ("open() returned %d instead of %d", handles[i], i + 2);
+    }
+  msg ("opened \"sample.txt\" %d times", HANDLE_CNT);
+
+  close (handles[HANDLE_CNT / 2]);
+  CHECK (open ("sample.txt") == handles[HANDLE_CNT / 2],
+         "reopen gets the closed fd back");
+  CHECK (filesize (handles[HANDLE_CNT - 1]) > 0, "last fd still works");
+}
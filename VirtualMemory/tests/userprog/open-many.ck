@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 100 times
+(open-many) reopen gets the closed fd back
+(open-many) last fd still works
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Writes a file with writev and pwrite and reads it back with
+   readv and pread, checking that only the vectored calls move
+   the file position, and that empty buffers are ignored. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  size_t size = sizeof sample - 1;
+  size_t half = size / 2;
+  struct iovec iov[2];
+  char buf[sizeof sample];
+  int handle;
+
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = (char *) sample;
+  iov[0].iov_len = half;
+  iov[1].iov_base = (char *) sample + half;
+  iov[1].iov_len = size - half;
+  CHECK (writev (handle, iov, 2) == (int) size, "writev \"test.txt\"");
+  CHECK (tell (handle) == size, "writev advanced the position");
+
+  memset (buf, 0, sizeof buf);
+  CHECK (pread (handle, buf, size, 0) == (int) size, "pread \"test.txt\"");
+  CHECK (!memcmp (buf, sample, size), "compare pread data");
+  CHECK (tell (handle) == size, "pread left the position alone");
+
+  CHECK (pwrite (handle, "pwrite", 6, half) == 6, "pwrite \"test.txt\"");
+  CHECK (tell (handle) == size, "pwrite left the position alone");
+
+  seek (handle, 0);
+  memset (buf, 0, sizeof buf);
+  iov[0].iov_base = buf;
+  iov[1].iov_base = buf + half;
+  CHECK (readv (handle, iov, 2) == (int) size, "readv \"test.txt\"");
+  CHECK (!memcmp (buf, sample, half)
+         && !memcmp (buf + half, "pwrite", 6)
+         && !memcmp (buf + half + 6, sample + half + 6, size - half - 6),
+         "compare readv data");
+  CHECK (tell (handle) == size, "readv advanced the position");
+
+  /* An empty buffer is skipped, whatever its base. */
+  seek (handle, 0);
+  iov[0].iov_base = (char *) 0x20101234;
+  iov[0].iov_len = 0;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = half;
+  CHECK (readv (handle, iov, 2) == (int) half,
+         "readv with an empty buffer at a bad address");
+
+  CHECK (readv (handle, iov, IOV_MAX + 1) == -1,
+         "readv with too many buffers must fail");
+  CHECK (pread (handle, buf, size, size) == 0, "pread at end reads nothing");
+}
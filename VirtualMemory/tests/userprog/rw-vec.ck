@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-vec) begin
+(rw-vec) create "test.txt"
+(rw-vec) open "test.txt"
+(rw-vec) writev "test.txt"
+(rw-vec) writev advanced the position
+(rw-vec) pread "test.txt"
+(rw-vec) compare pread data
+(rw-vec) pread left the position alone
+(rw-vec) pwrite "test.txt"
+(rw-vec) pwrite left the position alone
+(rw-vec) readv "test.txt"
+(rw-vec) compare readv data
+(rw-vec) readv advanced the position
+(rw-vec) readv with an empty buffer at a bad address
+(rw-vec) readv with too many buffers must fail
+(rw-vec) pread at end reads nothing
+(rw-vec) end
+rw-vec: exit(0)
+EOF
+pass;
@@ -0,0 +1,43 @@
+/* Child process of page-fault-par.
+   Touches every page of a 384 kB buffer several times, so that
+   nearly every access is a page fault once its siblings are
+   competing for frames, and checks that each page kept the value
+   last written to it. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-fault";
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 96
+#define PASS_CNT 4
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  int id = argc > 1 ? atoi (argv[1]) : 0;
+  size_t i;
+  int pass;
+
+  quiet = true;
+
+  for (pass = 0; pass < PASS_CNT; pass++)
+    {
+      /* Verify what the previous pass wrote, then overwrite it. */
+      for (i = 0; i < PAGE_CNT; i++)
+        {
+          int *word = (int *) (buf + i * PAGE_SIZE);
+          int expected = pass == 0 ? 0 : (id << 24) | ((pass - 1) << 16) | i;
+
+          if (*word != expected)
+            fail ("page %zu: %#x != %#x", i, *word, expected);
+          *word = (id << 24) | (pass << 16) | i;
+        }
+    }
+
+  return 0x42;
+}
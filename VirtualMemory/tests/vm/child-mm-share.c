@@ -0,0 +1,23 @@
+/* Child process of mmap-share.
+   Maps the file its parent has mapped and written to, checks
+   that the parent's data is there, and writes its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x20000000)
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("shared.txt")) > 1, "open \"shared.txt\"");
+  CHECK (mmap (handle, ACTUAL) != MAP_FAILED, "mmap \"shared.txt\"");
+  if (memcmp (ACTUAL, sample, sizeof sample))
+    fail ("parent's write to the mapping is not visible");
+  memcpy (ACTUAL, "child", 5);
+}
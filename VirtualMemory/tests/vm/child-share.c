@@ -0,0 +1,50 @@
+/* Child process of page-share.
+   Checks that its initialized data pages hold the values in the
+   executable, overwrites them with its own id, and checks that no
+   sibling's writes show through while they all run. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-share";
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+#define WORDS_PER_PAGE (PAGE_SIZE / sizeof (int))
+#define PASS_CNT 64
+
+static int data[PAGE_CNT * WORDS_PER_PAGE] =
+  {
+    [0 * WORDS_PER_PAGE] = 0x5a000000,
+    [1 * WORDS_PER_PAGE] = 0x5a000001,
+    [2 * WORDS_PER_PAGE] = 0x5a000002,
+    [3 * WORDS_PER_PAGE] = 0x5a000003,
+  };
+
+int
+main (int argc, char *argv[])
+{
+  int id = argc > 1 ? atoi (argv[1]) : 0;
+  size_t i;
+  int pass;
+
+  quiet = true;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (data[i * WORDS_PER_PAGE] != (int) (0x5a000000 | i))
+      fail ("page %zu: %#x before writing", i, data[i * WORDS_PER_PAGE]);
+
+  for (pass = 0; pass < PASS_CNT; pass++)
+    for (i = 0; i < PAGE_CNT; i++)
+      {
+        int expected = (pass == 0 ? (int) (0x5a000000 | i)
+                        : (int) ((id << 16) | i));
+
+        if (data[i * WORDS_PER_PAGE] != expected)
+          fail ("page %zu: %#x != %#x", i, data[i * WORDS_PER_PAGE], expected);
+        data[i * WORDS_PER_PAGE] = (id << 16) | i;
+      }
+
+  return 0x42;
+}
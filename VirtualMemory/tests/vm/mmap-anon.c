@@ -0,0 +1,47 @@
+/* Maps anonymous memory, checks that it reads as zeros, fills it,
+   and checks that a fresh mapping at the same address after
+   munmap is zeroed again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define SIZE (256 * 1024)
+
+static void
+check_zero (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != 0)
+      fail ("byte %zu is %d, not zero", i, ACTUAL[i]);
+}
+
+void
+test_main (void)
+{
+  mapid_t map;
+  size_t i;
+
+  CHECK ((map = mmap_anon (ACTUAL, SIZE)) != MAP_FAILED, "mmap_anon");
+  check_zero ();
+  msg ("mapping reads as zeros");
+
+  for (i = 0; i < SIZE; i++)
+    ACTUAL[i] = i % 251;
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != (char) (i % 251))
+      fail ("byte %zu is %d, not %d", i, ACTUAL[i], (char) (i % 251));
+  msg ("mapping holds written data");
+
+  CHECK (mmap_anon (ACTUAL + SIZE - 4096, 4096) == MAP_FAILED,
+         "overlapping mmap_anon must fail");
+  munmap (map);
+
+  CHECK ((map = mmap_anon (ACTUAL, SIZE)) != MAP_FAILED, "mmap_anon again");
+  check_zero ();
+  msg ("new mapping reads as zeros");
+  munmap (map);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap_anon
+(mmap-anon) mapping reads as zeros
+(mmap-anon) mapping holds written data
+(mmap-anon) overlapping mmap_anon must fail
+(mmap-anon) mmap_anon again
+(mmap-anon) new mapping reads as zeros
+(mmap-anon) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Writes to a file through a mapping and flushes the mapping
+   with msync, then reads the data in the file back using the read
+   system call while the mapping is still in place.  Writes again
+   and checks that a second msync flushes the new data too. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (map, MS_SYNC) == 0, "msync \"sample.txt\"");
+
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+
+  memcpy (ACTUAL, "msync", 5);
+  CHECK (msync (map, MS_SYNC) == 0, "msync \"sample.txt\" again");
+  seek (handle, 0);
+  read (handle, buf, 5);
+  CHECK (!memcmp (buf, "msync", 5), "compare read data against new data");
+
+  CHECK (msync (map, 0) == -1, "msync with bad flags must fail");
+  CHECK (msync (map + 1, MS_SYNC) == -1, "msync bad mapping must fail");
+  munmap (map);
+  close (handle);
+}
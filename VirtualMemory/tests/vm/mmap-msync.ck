@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "sample.txt"
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) msync "sample.txt"
+(mmap-msync) compare read data against written data
+(mmap-msync) msync "sample.txt" again
+(mmap-msync) compare read data against new data
+(mmap-msync) msync with bad flags must fail
+(mmap-msync) msync bad mapping must fail
+(mmap-msync) end
+EOF
+pass;
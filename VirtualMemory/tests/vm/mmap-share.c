@@ -0,0 +1,31 @@
+/* Maps a file, writes to it through the mapping, and runs
+   child-mm-share, which maps the same file.  Each process must
+   see the other's writes at once, without an munmap in between. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+
+  CHECK (create ("shared.txt", sizeof sample), "create \"shared.txt\"");
+  CHECK ((handle = open ("shared.txt")) > 1, "open \"shared.txt\"");
+  CHECK (mmap (handle, ACTUAL) != MAP_FAILED, "mmap \"shared.txt\"");
+  memcpy (ACTUAL, sample, sizeof sample);
+
+  CHECK ((child = exec ("child-mm-share")) != -1, "exec \"child-mm-share\"");
+  CHECK (wait (child) == 0, "wait for child (should return 0)");
+
+  if (memcmp (ACTUAL, "child", 5))
+    fail ("child's write to the mapping is not visible");
+  if (memcmp ((char *) ACTUAL + 5, sample + 5, sizeof sample - 5))
+    fail ("mapping corrupted");
+}
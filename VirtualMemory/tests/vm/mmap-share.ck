@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-share) begin
+(mmap-share) create "shared.txt"
+(mmap-share) open "shared.txt"
+(mmap-share) mmap "shared.txt"
+(mmap-share) exec "child-mm-share"
+(child-mm-share) begin
+(child-mm-share) open "shared.txt"
+(child-mm-share) mmap "shared.txt"
+(child-mm-share) end
+(mmap-share) wait for child (should return 0)
+(mmap-share) end
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Runs 8 child-fault processes at once, so that page faults from
+   different processes compete for frames and for the swap device.
+   The kernel's "Timer" and "Exception" statistics at shutdown give
+   the fault throughput. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 8
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char cmd_line[32];
+
+      snprintf (cmd_line, sizeof cmd_line, "child-fault %d", i);
+      CHECK ((children[i] = exec (cmd_line)) != -1,
+             "exec \"child-fault %d\"", i);
+    }
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fault-par) begin
+(page-fault-par) exec "child-fault 0"
+(page-fault-par) exec "child-fault 1"
+(page-fault-par) exec "child-fault 2"
+(page-fault-par) exec "child-fault 3"
+(page-fault-par) exec "child-fault 4"
+(page-fault-par) exec "child-fault 5"
+(page-fault-par) exec "child-fault 6"
+(page-fault-par) exec "child-fault 7"
+(page-fault-par) wait for child 0
+(page-fault-par) wait for child 1
+(page-fault-par) wait for child 2
+(page-fault-par) wait for child 3
+(page-fault-par) wait for child 4
+(page-fault-par) wait for child 5
+(page-fault-par) wait for child 6
+(page-fault-par) wait for child 7
+(page-fault-par) end
+EOF
+pass;
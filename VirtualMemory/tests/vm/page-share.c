@@ -0,0 +1,29 @@
+/* Runs 6 child-share processes at once.  They execute the same
+   executable, so they share its code and initialized data pages
+   until each one writes to its own copy of the data. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 6
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char cmd_line[32];
+
+      snprintf (cmd_line, sizeof cmd_line, "child-share %d", i);
+      CHECK ((children[i] = exec (cmd_line)) != -1,
+             "exec \"child-share %d\"", i);
+    }
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-share) begin
+(page-share) exec "child-share 0"
+(page-share) exec "child-share 1"
+(page-share) exec "child-share 2"
+(page-share) exec "child-share 3"
+(page-share) exec "child-share 4"
+(page-share) exec "child-share 5"
+(page-share) wait for child 0
+(page-share) wait for child 1
+(page-share) wait for child 2
+(page-share) wait for child 3
+(page-share) wait for child 4
+(page-share) wait for child 5
+(page-share) end
+EOF
+pass;
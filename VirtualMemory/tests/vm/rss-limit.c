@@ -0,0 +1,37 @@
+/* Limits the process to a few resident pages, then writes to many
+   more heap pages than that.  Checks that the process never has
+   more pages resident than its limit, that its pages survive
+   being replaced, and that the limit can be lifted again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 32
+#define PAGE_CNT 128
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  char *heap;
+  size_t i;
+
+  CHECK (rsslimit (LIMIT) == 0, "set resident set limit");
+  CHECK ((heap = sbrk (PAGE_CNT * 4096)) != (void *) -1, "grow heap");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      heap[i * 4096] = i;
+      vmstat (&st);
+      if (st.resident > LIMIT)
+        fail ("%zu pages resident after writing page %zu", st.resident, i);
+    }
+  msg ("resident set stayed within the limit");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (heap[i * 4096] != (char) i)
+      fail ("page %zu holds %d", i, heap[i * 4096]);
+  msg ("replaced pages kept their data");
+
+  CHECK (rsslimit (0) == LIMIT, "lift resident set limit");
+}
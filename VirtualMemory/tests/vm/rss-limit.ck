@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) set resident set limit
+(rss-limit) grow heap
+(rss-limit) resident set stayed within the limit
+(rss-limit) replaced pages kept their data
+(rss-limit) lift resident set limit
+(rss-limit) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Grows the heap with sbrk, writes to all of it, shrinks it and
+   grows it back, checking that the regained memory is zeroed.
+   Also checks that sbrk refuses to shrink below the heap's
+   start. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+void
+test_main (void)
+{
+  char *heap, *p;
+  size_t i;
+
+  heap = sbrk (0);
+  CHECK ((p = sbrk (SIZE)) == heap, "grow heap");
+  CHECK (sbrk (0) == heap + SIZE, "break moved");
+
+  for (i = 0; i < SIZE; i++)
+    heap[i] = i % 253;
+  for (i = 0; i < SIZE; i++)
+    if (heap[i] != (char) (i % 253))
+      fail ("byte %zu is %d, not %d", i, heap[i], (char) (i % 253));
+  msg ("heap holds written data");
+
+  CHECK (sbrk (-SIZE) == heap + SIZE, "shrink heap");
+  CHECK (sbrk (SIZE / 2) == heap, "grow heap again");
+  for (i = 0; i < SIZE / 2; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu is %d, not zero", i, heap[i]);
+  msg ("regained heap is zeroed");
+
+  CHECK (sbrk (-SIZE) == (void *) -1, "shrinking below the start must fail");
+}
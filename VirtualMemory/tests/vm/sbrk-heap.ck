@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-heap) begin
+(sbrk-heap) grow heap
+(sbrk-heap) break moved
+(sbrk-heap) heap holds written data
+(sbrk-heap) shrink heap
+(sbrk-heap) grow heap again
+(sbrk-heap) regained heap is zeroed
+(sbrk-heap) shrinking below the start must fail
+(sbrk-heap) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Checks that vmstat reports the faults and resident pages of a
+   heap that is touched page by page, and the write-back of a
+   dirty mapped page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 16
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  char *heap;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (vmstat (&before), "vmstat");
+  CHECK (before.resident > 0, "some pages resident");
+  CHECK (before.pinned == 0, "no pages pinned");
+
+  CHECK ((heap = sbrk (PAGE_CNT * 4096)) != (void *) -1, "grow heap");
+  for (i = 0; i < PAGE_CNT; i++)
+    heap[i * 4096] = 1;
+  vmstat (&after);
+  CHECK (after.minor_faults >= before.minor_faults + PAGE_CNT,
+         "touching the heap counts minor faults");
+  CHECK (after.resident >= before.resident + PAGE_CNT,
+         "touched heap pages are resident");
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  vmstat (&before);
+  munmap (map);
+  vmstat (&after);
+  CHECK (after.writebacks == before.writebacks + 1,
+         "munmap writes back the dirty page");
+  CHECK (after.resident == before.resident - 1,
+         "munmap frees the resident page");
+  close (handle);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vm-stats) begin
+(vm-stats) vmstat
+(vm-stats) some pages resident
+(vm-stats) no pages pinned
+(vm-stats) grow heap
+(vm-stats) touching the heap counts minor faults
+(vm-stats) touched heap pages are resident
+(vm-stats) create "sample.txt"
+(vm-stats) open "sample.txt"
+(vm-stats) mmap "sample.txt"
+(vm-stats) munmap writes back the dirty page
+(vm-stats) munmap frees the resident page
+(vm-stats) end
+EOF
+pass;
@@ -39,11 +39,15 @@
 #endif
 #include "userprog/debugf.h"
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* CR4 bit that enables 4 MB pages. */
+#define CR4_PSE 0x00000010
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -60,6 +64,12 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -fl, -fh: Free-frame watermarks for the page-out daemon. */
+static size_t frame_low_mark = FRAME_LOW_MARK;
+static size_t frame_high_mark = FRAME_HIGH_MARK;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -133,7 +143,7 @@ main (void)
 #endif
 
   DEBUGA("Initializing frame table%s", "\n");
-  frame_init();
+  frame_init (frame_low_mark, frame_high_mark);
   DEBUGA("Initializing swapping%s", "\n");
   swap_init();
   printf ("Boot complete.\n");
@@ -195,6 +205,19 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+#ifdef VM
+  /* Let page directory entries map 4 MB pages; see
+     pagedir_set_large_page().  [IA32-v3a] 3.7.3 "Mixing 4-KByte
+     and 4-MByte Pages". */
+  if (page_large_pages)
+    {
+      uint32_t cr4;
+
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE) : "memory");
+    }
+#endif
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -268,6 +291,25 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fl"))
+        frame_low_mark = atoi (value);
+      else if (!strcmp (name, "-fh"))
+        frame_high_mark = atoi (value);
+      else if (!strcmp (name, "-fa"))
+        page_fault_around = atoi (value);
+      else if (!strcmp (name, "-lp"))
+        page_large_pages = true;
+      else if (!strcmp (name, "-sl"))
+        page_stack_limit = atoi (value);
+      else if (!strcmp (name, "-stats"))
+        page_exit_stats = true;
+      else if (!strcmp (name, "-rp"))
+        {
+          if (!frame_select_policy (value))
+            PANIC ("unknown replacement policy `%s'", value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -390,6 +432,15 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fl=COUNT          Wake page-out daemon below COUNT free frames.\n"
+          "  -fh=COUNT          Page-out daemon stops at COUNT free frames.\n"
+          "  -fa=COUNT          Map up to COUNT neighbouring file pages per fault.\n"
+          "  -lp                Map untouched 4 MB of anonymous memory as one page.\n"
+          "  -sl=COUNT          Limit each process's stack to COUNT pages.\n"
+          "  -stats             Print each process's VM statistics at exit.\n"
+          "  -rp=POLICY         Use POLICY (clock, wsclock, clockpro) for eviction.\n"
 #endif
           );
   shutdown_power_off ();
@@ -51,7 +51,9 @@ static inline uintptr_t pd_no (const void *va) {
    |         Physical Address           |         Flags          |
    +------------------------------------+------------------------+
 
-   In a PDE, the physical address points to a page table.
+   In a PDE, the physical address points to a page table, or,
+   with PTE_PS set, to a 4 MB aligned run of pages mapped as one
+   large page.
    In a PTE, the physical address points to a data or code page.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -66,6 +68,8 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page (PDEs only, needs CR4.PSE). */
+#define PDE_LARGE_ADDR 0xffc00000 /* Address bits of a 4 MB page PDE. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -80,6 +84,21 @@ static inline uint32_t *pde_get_pt (uint32_t pde) {
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the PTSPAN bytes of physically
+   contiguous memory starting at PAGE as a single 4 MB page usable
+   by user code.  If WRITABLE is true the page is writable too. */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT ((vtop (page) & ~PDE_LARGE_ADDR) == 0);
+  return vtop (page) | PTE_U | PTE_P | PTE_PS | (writable ? PTE_W : 0);
+}
+
+/* Returns a pointer to the first page of the 4 MB page that PDE,
+   which must be present and have PTE_PS set, maps. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT ((pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS));
+  return ptov (pde & PDE_LARGE_ADDR);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -190,7 +190,8 @@ thread_create (const char *name, int priority,
 
   page_init(t);
   mmap_init(&t->m_table);
-  t->keep_pin = false;
+  fd_init(&t->fd_table);
+  t->user_access = false;
 
   t->info = malloc(sizeof(struct wait_info));
   t->info->num_ptrs = 0;
@@ -492,8 +493,6 @@ init_thread (struct thread *t, const char *name, int priority)
   // all thread should init the child list
   t->info = NULL;
   list_init(&t->children);
-  list_init(&t->fd_table);
-  t->next_fd = 2;
 
   sema_init(&t->load_sem, 0);
   t->load_status = 0;
@@ -104,7 +104,10 @@ struct thread
   struct thread *last_thread;
 
   void *last_stack;
-  bool keep_pin;
+  bool user_access;             /* In get_user() or put_user(). */
+
+  void *heap_start;             /* First page of the sbrk() heap. */
+  void *heap_brk;               /* Current end of the heap. */
 
   uint32_t *pagedir;		/* Page directory. */
 
@@ -114,8 +117,7 @@ struct thread
   struct semaphore load_sem;
   int load_status;
 
-  struct list fd_table;
-  unsigned next_fd;
+  struct fd_table fd_table;
 
   struct file* exec;
 #endif
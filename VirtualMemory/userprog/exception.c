@@ -10,8 +10,6 @@
 #include "vm/page.h"
 #include "vm/frame.h"
 
-#define STACK_BOTTOM PHYS_BASE - (8 * 1024 * 1024)
-
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
@@ -161,16 +159,29 @@ page_fault (struct intr_frame *f)
 
   if (is_user_vaddr(fault_addr))
   {
+    /* A write to a page still shared with other processes. */
+    if (!not_present && write
+        && page_break_cow (fault_addr, false))
+      return;
+
     if (user)
     {
-      if (page_fix_page(fault_addr, ((fault_addr > STACK_BOTTOM) ? true : false), write, false))
+      if (page_fix_page(fault_addr, true, write, false))
         return;
     }
     else
     {
-      if (page_fix_page(fault_addr, ((fault_addr > t->last_stack) ? true: false), write, t->keep_pin))
+      if (page_fix_page(fault_addr, ((fault_addr > t->last_stack) ? true: false), write, false))
         return;
     }
+    /* A bad address handed to get_user() or put_user(): resume
+       at the address they left in eax and report -1 there. */
+    if (!user && t->user_access)
+      {
+        f->eip = (void (*) (void)) f->eax;
+        f->eax = 0xffffffff;
+        return;
+      }
     DEBUGA("exception:: is_user_vaddr, but should fail%s","\n");
   }
 
@@ -10,6 +10,8 @@
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static uint32_t *lookup_large (uint32_t *pd, const void *vaddr);
+static bool split_large (uint32_t *pd, uint32_t *pde);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -36,7 +38,7 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P)
+    if ((*pde & PTE_P) && !(*pde & PTE_PS))
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -54,7 +56,10 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is mapped by a 4 MB page, it is first split into a
+   page table mapping the same frames; if no memory is left for
+   that page table, returns a null pointer. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -81,6 +86,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
       else
         return NULL;
     }
+  else if ((*pde & PTE_PS) && !split_large (pd, pde))
+    return NULL;
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -120,6 +127,40 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Maps the PTSPAN bytes of user virtual memory starting at UPAGE
+   to the physically contiguous pages starting at KPAGE with one
+   4 MB page.  UPAGE and the physical address of KPAGE must be
+   multiples of PTSPAN.  If WRITABLE is true, the pages are
+   read/write; otherwise they are read-only.
+   Returns false if PD already has a page table or a large page
+   for UPAGE.
+   CR4.PSE must have been set; see paging_init(). */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+
+  ASSERT ((uintptr_t) upage % PTSPAN == 0);
+  ASSERT (vtop (kpage) % PTSPAN == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large (kpage, writable);
+  return true;
+}
+
+/* Returns true if no page in the PTSPAN-aligned stretch of user
+   virtual memory containing UADDR has ever been mapped in PD. */
+bool
+pagedir_is_span_unused (uint32_t *pd, const void *uaddr)
+{
+  ASSERT (is_user_vaddr (uaddr));
+
+  return pd[pd_no (uaddr)] == 0;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -131,6 +172,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 
   ASSERT (is_user_vaddr (uaddr));
 
+  pte = lookup_large (pd, uaddr);
+  if (pte != NULL)
+    return (uint8_t *) pde_get_large_page (*pte) + ((uintptr_t) uaddr & (PTSPAN - 1));
+
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
@@ -141,8 +186,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
-void
+   UPAGE need not be mapped.  Returns false, leaving UPAGE
+   mapped, if it is part of a 4 MB page that could not be split
+   for lack of memory. */
+bool
 pagedir_clear_page (uint32_t *pd, void *upage)
 {
   uint32_t *pte;
@@ -150,12 +197,35 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
+  if (!pagedir_split_large (pd, upage))
+    return false;
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
       invalidate_pagedir (pd);
     }
+  return true;
+}
+
+/* Returns true if UADDR is mapped by a 4 MB page in PD. */
+bool
+pagedir_is_large_page (uint32_t *pd, const void *uaddr)
+{
+  ASSERT (is_user_vaddr (uaddr));
+
+  return lookup_large (pd, uaddr) != NULL;
+}
+
+/* If UADDR is mapped by a 4 MB page in PD, splits it into a page
+   table mapping the same frames.  Returns false, leaving the
+   large page in place, if memory for the page table is short. */
+bool
+pagedir_split_large (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pde = lookup_large (pd, uaddr);
+
+  return pde == NULL || split_large (pd, pde);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -165,16 +235,23 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage)
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
-   in PD. */
+   in PD.  For a page inside a 4 MB page, the bit of the whole
+   large page is set. */
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL)
     {
       if (dirty)
@@ -194,16 +271,23 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage)
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  For a page inside a 4 MB page, the bit of the
+   whole large page is set. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL)
     {
       if (accessed)
@@ -233,6 +317,39 @@ pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
     }
 }
 
+/* Returns the PDE for VADDR in PD if it maps VADDR with a 4 MB
+   page, otherwise a null pointer. */
+static uint32_t *
+lookup_large (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Replaces the 4 MB page that PDE in PD maps by a page table
+   that maps the same frames one page at a time, so that single
+   pages can be unmapped or changed.  Every page inherits the
+   large page's accessed and dirty bits.  Returns false if no
+   memory is left for the page table. */
+static bool
+split_large (uint32_t *pd, uint32_t *pde)
+{
+  uint8_t *kpage = pde_get_large_page (*pde);
+  uint32_t flags = *pde & (PTE_W | PTE_A | PTE_D);
+  uint32_t *pt;
+  size_t i;
+
+  pt = palloc_get_page (0);
+  if (pt == NULL)
+    return false;
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = pte_create_user (kpage + i * PGSIZE, false) | flags;
+  *pde = pde_create (pt);
+  invalidate_pagedir (pd);
+  return true;
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -7,8 +7,12 @@
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_is_span_unused (uint32_t *pd, const void *upage);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
-void pagedir_clear_page (uint32_t *pd, void *upage);
+bool pagedir_clear_page (uint32_t *pd, void *upage);
+bool pagedir_is_large_page (uint32_t *pd, const void *upage);
+bool pagedir_split_large (uint32_t *pd, const void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
@@ -92,7 +92,6 @@ process_execute (const char *command_line)
 static void
 start_process (void *cl_data_)
 {
-  struct thread *t = thread_current ();
   struct name_cl *cl_data = cl_data_;
   struct intr_frame if_;
   bool success;
@@ -107,8 +106,6 @@ start_process (void *cl_data_)
   if (success)
     {
       success = init_stack_args ((uint32_t**)&if_.esp, cl_data->cl_copy);
-      t->exec = filesys_open (cl_data->file_name);
-      file_deny_write (t->exec);
     }
   //sema up here
   cl_data->parr_t->load_status = (success) ? 1 : -1;
@@ -175,18 +172,12 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   uint32_t *pd;
-  struct list_elem *e;
-  struct fd_node *f;
 
+  if (page_exit_stats)
+    page_print_process_stats ();
   mmap_free_all();
 
-  while (!list_empty(&cur->fd_table))
-    {
-      e = list_pop_front (&cur->fd_table);
-      f = list_entry (e, struct fd_node, elem);
-      file_close(f->f_ptr);
-      free(f);
-    }
+  fd_close_all();
 
   page_free_all();
 
@@ -397,6 +388,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+              if ((uint8_t *) mem_page + read_bytes + zero_bytes > (uint8_t *) t->heap_start)
+                t->heap_start = (uint8_t *) mem_page + read_bytes + zero_bytes;
             }
           else
             goto done;
@@ -404,6 +397,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
         }
     }
 
+  /* The heap starts empty, right after the highest segment. */
+  t->heap_brk = t->heap_start;
+
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
@@ -414,8 +410,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.
+     On success the executable stays open for the life of the
+     process, since its pages are loaded (and reloaded after
+     eviction) from it on demand. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec = file;
+    }
+  else
+    file_close (file);
   return success;
 }
 
@@ -488,26 +493,10 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  while (read_bytes > 0 || zero_bytes > 0)
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      bool zero_page = (page_zero_bytes == PGSIZE);
-
-      /* Set page entry */
-      page_alloc_page (upage, writable, false, false, zero_page, file, ofs, page_read_bytes);
-      DEBUGA("load_segment:: Allocated page at upage: %p\n", upage);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      ofs += page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-    }
+  /* Pages are read in lazily by page_fix_page. */
+  if (!page_alloc_area (upage, (read_bytes + zero_bytes) / PGSIZE, writable,
+                        false, file, ofs, read_bytes))
+    return false;
   DEBUGA("** %s: Finished load_segment\n", thread_current()->name);
   return true;
 }
@@ -517,7 +506,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp)
 {
-  page_alloc_page(((uint8_t *) PHYS_BASE) - PGSIZE, true, true, false, false, NULL, 0, 0);
+  if (!page_alloc_stack ())
+    return false;
 
   DEBUGA("setup_stack:: %p\n", ((uint8_t *) PHYS_BASE) - PGSIZE);
 
@@ -1,10 +1,13 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <round.h>
 #include <syscall-nr.h>
+#include <bitmap.h>
 #include <hash.h>
 #include <string.h>
 #include "devices/shutdown.h"
 #include "devices/block.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "lib/user/syscall.h"
@@ -16,18 +19,36 @@
 #include "userprog/process.h"
 #include "userprog/debugf.h"
 #include "userprog/syscall.h"
+#include "vm/frame.h"
 #include "vm/page.h"
 
-#define NUM_SYS_ARGS 15
+#define NUM_SYS_ARGS (SYS_PWRITE + 1)
 
-typedef int syscall_function (uint32_t, uint32_t, uint32_t);
+/* Number of fds in a process's first fd table; it doubles when
+   full. */
+#define FD_TABLE_MIN 16
+
+/* Mappings and the heap stay below this, leaving room for the
+   stack. */
+#define USER_MAP_LIMIT (page_stack_bottom ())
+
+typedef int syscall_function (uint32_t, uint32_t, uint32_t, uint32_t);
 static void syscall_handler (struct intr_frame *);
 
 static int get_user (const uint8_t *);
-static bool user_to_kernel_memcopy (int *, uint32_t *, size_t);
-
-static char *copy_to_kernel (const char *str);
+static bool put_user (uint8_t *, uint8_t);
+static bool copy_from_user (void *, const void *, size_t);
+static bool copy_to_user (void *, const void *, size_t);
+static int strncpy_from_user (char *, const char *, size_t);
+static bool copy_file_name (char *, const char *);
+static bool copy_iovec (struct iovec *, const struct iovec *, int iovcnt);
+static void check_user_buffer (void *, size_t, bool);
+static bool pin_user_buffer (void *, size_t, bool);
+static void unpin_user_buffer (void *, size_t);
+static int transfer_iovec (int fd, const struct iovec *, int iovcnt,
+                           off_t pos, bool write);
 static struct file *get_file_by_fd (int fd);
+static int fd_alloc (struct fd_table *, struct file *);
 
 static syscall_function *sys_calls[NUM_SYS_ARGS];
 
@@ -45,13 +66,22 @@ static unsigned sys_tell (int fd);
 static void sys_close (int fd);
 static mapid_t sys_mmap (int fd, void *uaddr);
 static void sys_munmap (mapid_t mmap);
-
-//struct lock file_lock;
+static int sys_msync (mapid_t mmap, int flags);
+static mapid_t sys_mmap_anon (void *uaddr, size_t length);
+static void *sys_sbrk (intptr_t increment);
+static bool sys_vmstat (struct vmstat *st);
+static size_t sys_rsslimit (size_t page_cnt);
+static int sys_readv (int fd, const struct iovec *iov, int iovcnt);
+static int sys_writev (int fd, const struct iovec *iov, int iovcnt);
+static int sys_pread (int fd, void *buffer, unsigned size, unsigned offset);
+static int sys_pwrite (int fd, const void *buffer, unsigned size,
+                       unsigned offset);
 
 struct hash mapped_files;
 static unsigned mmap_hash (const struct hash_elem *, void *aux UNUSED);
 static bool mmap_less (const struct hash_elem *, const struct hash_elem *, void *aux UNUSED);
 static void mmap_free_entry (struct hash_elem *e, void *aux UNUSED);
+static mapid_t mmap_add_entry (void *upage, size_t page_cnt, struct file *);
 
 struct mmap_entry
 {
@@ -82,16 +112,23 @@ syscall_init (void)
   sys_calls[SYS_CLOSE] = (syscall_function *) sys_close;
   sys_calls[SYS_MMAP] = (syscall_function *) sys_mmap;
   sys_calls[SYS_MUNMAP] = (syscall_function *) sys_munmap;
-
-  sema_init (&file_lock, 1);
+  sys_calls[SYS_MSYNC] = (syscall_function *) sys_msync;
+  sys_calls[SYS_MMAP_ANON] = (syscall_function *) sys_mmap_anon;
+  sys_calls[SYS_SBRK] = (syscall_function *) sys_sbrk;
+  sys_calls[SYS_VMSTAT] = (syscall_function *) sys_vmstat;
+  sys_calls[SYS_RSSLIMIT] = (syscall_function *) sys_rsslimit;
+  sys_calls[SYS_READV] = (syscall_function *) sys_readv;
+  sys_calls[SYS_WRITEV] = (syscall_function *) sys_writev;
+  sys_calls[SYS_PREAD] = (syscall_function *) sys_pread;
+  sys_calls[SYS_PWRITE] = (syscall_function *) sys_pwrite;
 }
 
 static void
 syscall_handler (struct intr_frame *f)
 {
   uint8_t *stack_ptr = f->esp;
-  uint32_t args[4];
-  size_t i;
+  uint32_t args[5];
+  size_t cnt;
   int ret_val;
 
 #ifdef SHOW_HEX
@@ -102,22 +139,24 @@ syscall_handler (struct intr_frame *f)
   if (stack_ptr + 4 >= (uint8_t *) PHYS_BASE)
     sys_exit (-1);
 
-  for (i = 0; i < 4; i++)
-    {
-      if (!user_to_kernel_memcopy
-	        ((int *) stack_ptr + i, &args[i], sizeof (int)))
-        {
-	        //sys_exit(-1);
-	      }
-      DEBUGF ("args[%d] = %p\n", i, args[i]);
-    }
+  /* Fetch the call number and as many arguments as lie below
+     PHYS_BASE; a call near the top of the stack that takes fewer
+     arguments is legal, and the missing ones read as zero. */
+  memset (args, 0, sizeof args);
+  cnt = ((uint8_t *) PHYS_BASE - stack_ptr) / sizeof *args;
+  if (cnt > 5)
+    cnt = 5;
+  if (!copy_from_user (args, stack_ptr, cnt * sizeof *args))
+    sys_exit (-1);
 
   DEBUGF ("system call number = %d\n", args[0]);
 
   struct thread *t = thread_current();
   t->last_stack = f->esp;
 
-  ret_val = sys_calls[args[0]] (args[1], args[2], args[3]);
+  if (args[0] >= NUM_SYS_ARGS || sys_calls[args[0]] == NULL)
+    sys_exit (-1);
+  ret_val = sys_calls[args[0]] (args[1], args[2], args[3], args[4]);
 
   DEBUGF ("syscall finished, returning %d\n", ret_val);
   f->eax = ret_val;
@@ -125,27 +164,143 @@ syscall_handler (struct intr_frame *f)
   return;
 }
 
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   UADDR is not mapped.  A fault here is fixed up by
+   page_fault(), which resumes at the label whose address was
+   left in eax and sets eax to -1. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  struct thread *t = thread_current ();
+  int result;
+
+  t->user_access = true;
+  asm volatile ("movl $1f, %0; movzbl %1, %0; 1:"
+                : "=&a" (result) : "m" (*uaddr));
+  t->user_access = false;
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if UDST is not
+   mapped writable. */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  struct thread *t = thread_current ();
+  int error_code;
+
+  t->user_access = true;
+  asm volatile ("movl $1f, %0; movb %b2, %1; 1:"
+                : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  t->user_access = false;
+  return error_code != -1;
+}
+
+/* Returns true if the SIZE bytes at UADDR lie entirely below
+   PHYS_BASE. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return (uintptr_t) uaddr <= (uintptr_t) PHYS_BASE
+         && size <= (uintptr_t) PHYS_BASE - (uintptr_t) uaddr;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Each page of USRC is probed once with get_user() and then
+   copied whole; once a page is known to be mapped, a fault while
+   copying it (because it was evicted in between) is an ordinary
+   page-in.  Returns false if any part of USRC is invalid, in
+   which case DST holds a partial copy. */
+static bool
+copy_from_user (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  if (!is_user_range (usrc, size))
+    return false;
+  while (size > 0)
+    {
+      size_t chunk = PGSIZE - pg_ofs (usrc);
+      if (chunk > size)
+        chunk = size;
+
+      if (get_user (usrc) < 0)
+        return false;
+      memcpy (dst, usrc, chunk);
+
+      dst += chunk;
+      usrc += chunk;
+      size -= chunk;
+    }
+  return true;
+}
+
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST,
+   probing each page of UDST for writability as copy_from_user()
+   does for reading.  Returns false if any part of UDST is
+   invalid or read-only. */
 static bool
-user_to_kernel_memcopy (int *uaddr, uint32_t * kaddr, size_t size)
+copy_to_user (void *udst_, const void *src_, size_t size)
 {
-  size_t i;
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
 
-  for (i = 0; i < size; i++)
+  if (!is_user_range (udst, size))
+    return false;
+  while (size > 0)
     {
-      //if (get_user ((void *) uaddr + i) < 0)
-      if (!is_user_vaddr (uaddr + i))
-	      return false;
-      *((int *) ((void *) kaddr + i)) = get_user ((void *) uaddr + i);
+      size_t chunk = PGSIZE - pg_ofs (udst);
+      if (chunk > size)
+        chunk = size;
+
+      if (!put_user (udst, *src))
+        return false;
+      memcpy (udst + 1, src + 1, chunk - 1);
+
+      udst += chunk;
+      src += chunk;
+      size -= chunk;
     }
   return true;
 }
 
+/* Copies the null-terminated string at user address USRC into
+   DST, a buffer of SIZE bytes, one page span at a time.  Returns
+   the length of the string; SIZE if it does not fit, in which
+   case DST holds a truncated, null-terminated copy; or -1 if
+   USRC is invalid. */
 static int
-get_user (const uint8_t * uaddr)
+strncpy_from_user (char *dst, const char *usrc, size_t size)
 {
-  int result;
-asm ("movl $1f, %0; movzbl %1, %0; 1:": "=&a" (result):"m" (*uaddr));
-  return result;
+  size_t len = 0;
+
+  ASSERT (size > 0);
+
+  while (len < size)
+    {
+      size_t chunk = PGSIZE - pg_ofs (usrc + len);
+      const char *nul;
+
+      if (!is_user_vaddr (usrc + len)
+          || get_user ((const uint8_t *) usrc + len) < 0)
+        return -1;
+
+      if (chunk > size - len)
+        chunk = size - len;
+      nul = memchr (usrc + len, '\0', chunk);
+      if (nul != NULL)
+        chunk = nul - (usrc + len) + 1;
+      memcpy (dst + len, usrc + len, chunk);
+      len += chunk;
+
+      if (nul != NULL)
+        return len - 1;
+    }
+  dst[size - 1] = '\0';
+  return size;
 }
 
 static void
@@ -167,7 +322,19 @@ sys_exit (int status)
 static pid_t
 sys_exec (const char *command_line)
 {
-  return process_execute (command_line);
+  char *cl_copy = palloc_get_page (0);
+  pid_t pid;
+
+  if (cl_copy == NULL)
+    return TID_ERROR;
+  if (strncpy_from_user (cl_copy, command_line, PGSIZE) < 0)
+    {
+      palloc_free_page (cl_copy);
+      sys_exit (-1);
+    }
+  pid = process_execute (cl_copy);
+  palloc_free_page (cl_copy);
+  return pid;
 }
 
 static int
@@ -179,75 +346,46 @@ sys_wait (pid_t pid)
 static bool
 sys_create (const char *file, unsigned initial_size)
 {
-  char *file_path = copy_to_kernel (file);
-
-  bool retval = filesys_create (file_path, initial_size);
+  char file_path[NAME_MAX + 2];
 
-  palloc_free_page(file_path);
-
-  return retval;
+  if (!copy_file_name (file_path, file))
+    return false;
+  return filesys_create (file_path, initial_size);
 }
 
 static bool
 sys_remove (const char *file)
 {
-  char *file_path = copy_to_kernel (file);
+  char file_path[NAME_MAX + 2];
 
-  bool retval = filesys_remove (file_path);
-
-  palloc_free_page(file_path);
-
-  return retval;
+  if (!copy_file_name (file_path, file))
+    return false;
+  return filesys_remove (file_path);
 }
 
 static int
 sys_open (const char *file)
 {
-  struct thread *t;
-  char *file_path = copy_to_kernel (file);
+  char file_path[NAME_MAX + 2];
   struct file *f = NULL;
-  struct fd_node *fd_n;
+  int fd;
+
+  if (!copy_file_name (file_path, file))
+    return -1;
 
   DEBUGF ("file = %s\n", file);
   DEBUGF ("file_path = %s\n", file_path);
 
-  sema_down (&file_lock);
   f = filesys_open (file_path);
-  sema_up (&file_lock);
 
   DEBUGF ("f = %p\n", f);
-  if (f != NULL)
-    {
-      t = thread_current ();
-      fd_n = malloc (sizeof (struct fd_node));
-
-      fd_n->f_ptr = f;
-
-      fd_n->fd = t->next_fd;
-
-      list_push_back (&t->fd_table, &fd_n->elem);
-
-      struct list_elem *e;
-      int next_fd = 2;
-      struct fd_node *temp;
-
-      for (e = list_begin (&t->fd_table); e != list_end (&t->fd_table);
-	        e = list_next (e))
-        {
-          temp = list_entry (e, struct fd_node, elem);
-          if (next_fd != temp->fd)
-            {
-              break;
-            }
-          next_fd++;
-        }
+  if (f == NULL)
+    return -1;
 
-      t->next_fd = next_fd;
-      palloc_free_page(file_path);
-      return fd_n->fd;
-    }
-  palloc_free_page(file_path);
-  return -1;
+  fd = fd_alloc (&thread_current ()->fd_table, f);
+  if (fd < 0)
+    file_close (f);
+  return fd;
 }
 
 static int
@@ -274,34 +412,19 @@ sys_read (int fd, void *buffer, unsigned size)
 
   if (file != NULL)
   {
-    size_t bytes_left = size;
-    void *upage = pg_round_down (buffer);
-    struct thread *t = thread_current();
+    struct thread *t UNUSED = thread_current();
 
     DEBUGB("[%s] sys_read:: writing to filesystem; buffer %p; size %d; end buff: %p\n", t->name, buffer, size, buffer + size);
-    t->keep_pin = true;
     memset(buffer, 0, size);
-    while (bytes_left > 0) {
-      page_pin_frame (upage, true);
-      bytes_left -= (bytes_left < PGSIZE) ? bytes_left : PGSIZE;
-      upage += PGSIZE;
-    }
-    t->keep_pin = false;
+    if (!pin_user_buffer (buffer, size, true))
+      sys_exit (-1);
     DEBUGB("[%s] sys_read:: pinning complete\n", t->name);
 
 
-    sema_down (&file_lock);
     retval = file_read (file, buffer, size);
-    sema_up (&file_lock);
 
-    bytes_left = size;
-    upage = pg_round_down (buffer);
     DEBUGB("[%s] sys_read:: unpinning all the pages\n", t->name);
-    while (bytes_left > 0) {
-      page_unpin_frame (upage);
-      bytes_left -= (bytes_left < PGSIZE) ? bytes_left : PGSIZE;
-      upage += PGSIZE;
-    }
+    unpin_user_buffer (buffer, size);
   }
 
   return retval;
@@ -313,14 +436,15 @@ sys_write (int fd, const char *buffer, unsigned size)
   if (!is_user_vaddr (buffer) || !is_user_vaddr (buffer + size))
     sys_exit(-1);
 
-  unsigned i;
-
   if (fd == 1)
     {
-      for (i = 0; i < size; i++)
-	      printf ("%c", *(buffer + i));
+      /* One pass through putbuf(), with the buffer pinned so that
+         no page fault happens while holding the console lock. */
+      struct iovec iov;
 
-      return size;
+      iov.iov_base = (void *) buffer;
+      iov.iov_len = size;
+      return transfer_iovec (fd, &iov, 1, -1, true);
     }
 
   int retval = -1;
@@ -328,32 +452,16 @@ sys_write (int fd, const char *buffer, unsigned size)
   struct file *file = get_file_by_fd (fd);
   if (file != NULL)
     {
-      size_t bytes_left = size;
-      void *upage = pg_round_down (buffer);
-      struct thread *t = thread_current ();
-      t->keep_pin = true;
+      struct thread *t UNUSED = thread_current ();
       DEBUGB("[%s] sys_write:: writing to filesystem; buffer %p; size %d; end buff: %p\n", t->name, buffer, size, buffer + size);
-      while (bytes_left > 0 || upage - PGSIZE < buffer + size) {
-        int dumm = *(int*)upage;
-        page_pin_frame (upage, false);
-        bytes_left -= (bytes_left < PGSIZE) ? bytes_left : PGSIZE;
-        upage += PGSIZE;
-      }
-      t->keep_pin = false;
+      if (!pin_user_buffer ((void *) buffer, size, false))
+        sys_exit (-1);
       DEBUGB("[%s] sys_write:: pinning complete\n", t->name);
 
-      sema_down (&file_lock);
       retval = file_write (file, buffer, size);
-      sema_up (&file_lock);
 
-      bytes_left = size;
-      upage = pg_round_down (buffer);
       DEBUGB("[%s] sys_write:: unpinning all the pages\n", t->name);
-      while (bytes_left > 0) {
-        page_unpin_frame (upage);
-        bytes_left -= (bytes_left < PGSIZE) ? bytes_left : PGSIZE;
-        upage += PGSIZE;
-      }
+      unpin_user_buffer ((void *) buffer, size);
     }
 
   return retval;
@@ -365,11 +473,7 @@ sys_seek (int fd, unsigned position)
   struct file *file = get_file_by_fd (fd);
 
   if (file != NULL)
-    {
-      sema_down (&file_lock);
-      file_seek (file, position);
-      sema_up (&file_lock);
-    }
+    file_seek (file, position);
 }
 
 static unsigned
@@ -379,11 +483,7 @@ sys_tell (int fd)
   int retval = -1;
 
   if (file != NULL)
-    {
-      sema_down (&file_lock);
-      retval = file_tell (file);
-      sema_up (&file_lock);
-    }
+    retval = file_tell (file);
 
   return retval;
 }
@@ -391,47 +491,14 @@ sys_tell (int fd)
 static void
 sys_close (int fd)
 {
-  struct thread *t = thread_current ();
-  struct list_elem *e;
-  struct fd_node *f;
+  struct fd_table *ft = &thread_current ()->fd_table;
+  struct file *file = get_file_by_fd (fd);
 
-  for (e = list_begin (&t->fd_table); e != list_end (&t->fd_table);
-       e = list_next (e))
+  if (file != NULL)
     {
-      f = list_entry (e, struct fd_node, elem);
-      if (f->fd == fd)
-        {
-          t->next_fd = f->fd;
-
-
-          struct hash_iterator iter;
-          struct mmap_entry *mme = NULL;
-
-          hash_first (&iter, &t->m_table.table);
-          while (hash_next (&iter))
-            {
-              mme = hash_entry (hash_cur (&iter), struct mmap_entry, elem);
-              if (mme->file == f->f_ptr)
-                {
-                  unsigned i;
-                  void *upage;
-
-                  for (i = 0, upage = mme->start_upage; i < mme->num_pages; i++, upage += PGSIZE) {
-                    page_unmap (upage);
-                    page_fix_page (upage, false, false, false);
-                  }
-                  break;
-                }
-              }
-
-          sema_down (&file_lock);
-          file_close (f->f_ptr);
-          sema_up (&file_lock);
-
-          list_remove (e);
-          free (f);
-          return;
-        }
+      ft->files[fd] = NULL;
+      bitmap_reset (ft->used, fd);
+      file_close (file);
     }
 }
 
@@ -445,7 +512,7 @@ mmap_init (struct mmap_table *mt)
 static mapid_t
 sys_mmap (int fd, void *upage)
 {
-  if (upage > PHYS_BASE - 8 * 1024 * 1024 || fd == 0 || fd == 1 || upage == 0 || pg_ofs (upage))
+  if (upage > USER_MAP_LIMIT || fd == 0 || fd == 1 || upage == 0 || pg_ofs (upage))
     return -1;
 
   struct file *f = get_file_by_fd (fd);
@@ -456,33 +523,196 @@ sys_mmap (int fd, void *upage)
   if (read_bytes == 0)
     return -1;
 
-  size_t ofs = 0;
   bool writable = file_is_allow_write(f);
+  size_t page_cnt = DIV_ROUND_UP (read_bytes, PGSIZE);
+  if (page_cnt > (size_t) (USER_MAP_LIMIT - upage) / PGSIZE)
+    return -1;
 
-  struct thread *t = thread_current ();
+  struct thread *t UNUSED = thread_current ();
+
+  DEBUGB("[%s] sys_mmap:: mapping file %p to upage %p; file_length: %u\n", t->name, f, upage, read_bytes);
+
+  /* The mapping keeps its own handle on the file, so closing FD
+     leaves it untouched. */
+  f = file_reopen (f);
+  if (f == NULL)
+    return -1;
+
+  if (!page_alloc_area (upage, page_cnt, writable, true, f, 0, read_bytes))
+    {
+      file_close (f);
+      return -1;
+    }
+
+  return mmap_add_entry (upage, page_cnt, f);
+}
 
+/* Maps LENGTH bytes of zero-filled memory at UPAGE.  The pages
+   are allocated as they are touched and go to swap, not to a
+   file, when evicted.  Returns the mapping id, or -1 on failure. */
+static mapid_t
+sys_mmap_anon (void *upage, size_t length)
+{
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  if (upage == 0 || pg_ofs (upage) || length == 0
+      || upage > USER_MAP_LIMIT || page_cnt > (size_t) (USER_MAP_LIMIT - upage) / PGSIZE)
+    return -1;
+
+  DEBUGB("[%s] sys_mmap_anon:: mapping %u bytes at upage %p\n", thread_current ()->name, length, upage);
+
+  if (!page_alloc_area (upage, page_cnt, true, false, NULL, 0, 0))
+    return -1;
+
+  return mmap_add_entry (upage, page_cnt, NULL);
+}
+
+/* Records a mapping of PAGE_CNT pages at UPAGE, backed by F or
+   anonymous if F is null, and returns its id.  Undoes the mapping
+   and returns -1 if out of memory. */
+static mapid_t
+mmap_add_entry (void *upage, size_t page_cnt, struct file *f)
+{
+  struct thread *t = thread_current ();
   struct mmap_entry *mme = malloc(sizeof(struct mmap_entry));
+
+  if (mme == NULL)
+    {
+      page_free_area (upage);
+      file_close (f);
+      return -1;
+    }
   mme->mid = t->m_table.last_id++;
   mme->start_upage = upage;
-  mme->num_pages = 0;
+  mme->num_pages = page_cnt;
   mme->file = f;
 
-  DEBUGB("[%s] sys_mmap:: mapping file %p to upage %p; file_length: %u\n", t->name, mme->file, mme->start_upage, read_bytes);
+  hash_insert (&t->m_table.table, &mme->elem);
+  return mme->mid;
+}
 
-  while (read_bytes > 0) {
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+/* Moves the end of the heap by INCREMENT bytes and returns its
+   old end, or (void *) -1 if the heap cannot grow that far.  The
+   heap is an anonymous area right after the executable's
+   segments; pages are allocated when first touched and freed
+   when the heap shrinks below them. */
+static void *
+sys_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ();
+  uint8_t *start = t->heap_start;
+  uint8_t *old_brk = t->heap_brk;
+  uint8_t *new_brk = old_brk + increment;
+  size_t old_cnt, new_cnt;
+  bool success = true;
+
+  if ((increment > 0 && (new_brk < old_brk || new_brk > (uint8_t *) USER_MAP_LIMIT))
+      || (increment < 0 && (new_brk > old_brk || new_brk < start)))
+    return (void *) -1;
+
+  old_cnt = DIV_ROUND_UP (old_brk - start, PGSIZE);
+  new_cnt = DIV_ROUND_UP (new_brk - start, PGSIZE);
+  if (new_cnt != old_cnt)
+    {
+      if (old_cnt == 0)
+        success = page_alloc_area (start, new_cnt, true, false, NULL, 0, 0);
+      else if (new_cnt == 0)
+        page_free_area (start);
+      else
+        success = page_resize_area (start, new_cnt);
+    }
+  if (!success)
+    return (void *) -1;
 
-    if (!page_alloc_page (upage, writable, false, true, false, f, ofs, page_read_bytes))
-      return -1;
+  DEBUGB("[%s] sys_sbrk:: break moved from %p to %p\n", t->name, old_brk, new_brk);
+  t->heap_brk = new_brk;
+  return old_brk;
+}
 
-    read_bytes -= page_read_bytes;
-    ofs += page_read_bytes;
-    upage +=PGSIZE;
-    mme->num_pages++;
-  }
+/* Initializes FT as an empty table.  Memory for it is allocated
+   by the first open. */
+void
+fd_init (struct fd_table *ft)
+{
+  ft->files = NULL;
+  ft->used = NULL;
+  ft->size = 0;
+}
 
-  hash_insert (&t->m_table.table, &mme->elem);
-  return mme->mid;
+/* Grows FT to hold twice as many fds, or FD_TABLE_MIN if it is
+   empty.  Returns false if memory is short. */
+static bool
+fd_grow (struct fd_table *ft)
+{
+  size_t size = ft->size > 0 ? ft->size * 2 : FD_TABLE_MIN;
+  struct file **files;
+  struct bitmap *used;
+
+  /* Get the bitmap first, since it is the one allocation that can
+     be undone.  Once realloc succeeds the old array is gone, so FT
+     adopts the new one right away. */
+  used = bitmap_create (size);
+  if (used == NULL)
+    return false;
+  files = realloc (ft->files, size * sizeof *files);
+  if (files == NULL)
+    {
+      bitmap_destroy (used);
+      return false;
+    }
+  ft->files = files;
+
+  memset (files + ft->size, 0, (size - ft->size) * sizeof *files);
+  if (ft->used != NULL)
+    {
+      size_t fd;
+
+      for (fd = 0; fd < ft->size; fd++)
+        bitmap_set (used, fd, bitmap_test (ft->used, fd));
+      bitmap_destroy (ft->used);
+    }
+  else
+    bitmap_set_multiple (used, 0, 2, true);
+  ft->used = used;
+  ft->size = size;
+  return true;
+}
+
+/* Gives F the lowest free fd in FT, growing FT if it is full.
+   Returns the fd, or -1 if memory is short. */
+static int
+fd_alloc (struct fd_table *ft, struct file *f)
+{
+  size_t fd = ft->used != NULL ? bitmap_scan_and_flip (ft->used, 0, 1, false)
+                               : BITMAP_ERROR;
+
+  if (fd == BITMAP_ERROR)
+    {
+      fd = ft->size;
+      if (!fd_grow (ft))
+        return -1;
+      if (fd == 0)
+        fd = 2;
+      bitmap_mark (ft->used, fd);
+    }
+  ft->files[fd] = f;
+  return fd;
+}
+
+/* Closes every file the running process has open. */
+void
+fd_close_all (void)
+{
+  struct fd_table *ft = &thread_current ()->fd_table;
+  size_t fd;
+
+  for (fd = 0; fd < ft->size; fd++)
+    if (ft->files[fd] != NULL)
+      file_close (ft->files[fd]);
+  free (ft->files);
+  if (ft->used != NULL)
+    bitmap_destroy (ft->used);
+  fd_init (ft);
 }
 
 void
@@ -493,17 +723,14 @@ mmap_free_all (void)
   hash_destroy (&t->m_table.table, mmap_free_entry);
 }
 
+/* Closes F, a mapping's handle on its file. */
 static void
 mmap_free_entry (struct hash_elem *e, void *aux UNUSED)
 {
   struct mmap_entry *mme = hash_entry (e, struct mmap_entry, elem);
-  unsigned i;
-  void* upage;
-
-  for (i = 0, upage = mme->start_upage; i < mme->num_pages; i++, upage += PGSIZE) {
-    page_free_page (upage);
-  }
 
+  page_free_area (mme->start_upage);
+  file_close (mme->file);
   free(mme);
 }
 
@@ -515,57 +742,308 @@ sys_munmap (mapid_t mid)
   struct mmap_entry m;
   m.mid = mid;
   struct hash_elem *e = hash_find (&t->m_table.table, &m.elem);
-  unsigned i;
-  void *upage;
 
   if (e == NULL)
     return;
 
   struct mmap_entry *mme = hash_entry (e, struct mmap_entry, elem);
 
-  for (i = 0, upage = mme->start_upage; i < mme->num_pages; i++, upage += PGSIZE) {
-    page_free_page (upage);
-  }
+  page_free_area (mme->start_upage);
+  file_close (mme->file);
   hash_delete(&t->m_table.table, &mme->elem);
   free (mme);
 }
 
-static char *
-copy_to_kernel (const char *str)
+/* Writes the pages of mapping MID that were written to since they
+   were last written back to the file.  With MS_ASYNC the writes
+   are only queued.  Returns 0 if successful, -1 if MID or FLAGS is
+   invalid. */
+static int
+sys_msync (mapid_t mid, int flags)
 {
-  int size = strlen (str) + 1;
-  char *retval = palloc_get_page (1);
+  struct thread *t = thread_current ();
+  struct mmap_entry m;
+  m.mid = mid;
+  struct hash_elem *e = hash_find (&t->m_table.table, &m.elem);
+  unsigned i;
+  void *upage;
+
+  if (e == NULL || (flags != MS_SYNC && flags != MS_ASYNC))
+    return -1;
+
+  struct mmap_entry *mme = hash_entry (e, struct mmap_entry, elem);
+
+  for (i = 0, upage = mme->start_upage; i < mme->num_pages; i++, upage += PGSIZE)
+    page_sync (upage, flags == MS_ASYNC);
+  return 0;
+}
+
+/* Fills in *ST with the running process's virtual memory
+   statistics. */
+static bool
+sys_vmstat (struct vmstat *st)
+{
+  struct thread *t = thread_current ();
+  struct supp_page_table *spt = &t->page_table;
+  struct vmstat k;
+
+  k.minor_faults = spt->stats.minor_faults;
+  k.major_faults = spt->stats.major_faults;
+  k.swap_ins = spt->stats.swap_ins;
+  k.swap_outs = spt->stats.swap_outs;
+  k.writebacks = spt->stats.writebacks;
+  k.resident = spt->stats.resident;
+  k.pinned = frame_pinned_cnt (t->pagedir);
+
+  if (st == NULL || !copy_to_user (st, &k, sizeof k))
+    sys_exit (-1);
+  return true;
+}
+
+/* Limits the running process, and the processes it starts from
+   now on, to PAGE_CNT resident pages; 0 removes the limit.  A
+   process at its limit evicts its own pages to fault in more.
+   Limits below PAGE_RSS_MIN are raised to it.  Returns the
+   previous limit. */
+static size_t
+sys_rsslimit (size_t page_cnt)
+{
+  struct supp_page_table *spt = &thread_current ()->page_table;
+  size_t old = spt->rss_limit;
 
-  if (size > PGSIZE)
+  if (page_cnt != 0 && page_cnt < PAGE_RSS_MIN)
+    page_cnt = PAGE_RSS_MIN;
+  spt->rss_limit = page_cnt;
+  return old;
+}
+
+/* Copies the IOVCNT entries of user array UIOV into IOV, which
+   has room for IOV_MAX.  Exits the process if UIOV is invalid.
+   Returns false if IOVCNT is out of range or the buffers add up
+   to more than a file can hold. */
+static bool
+copy_iovec (struct iovec *iov, const struct iovec *uiov, int iovcnt)
+{
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return false;
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+    sys_exit (-1);
+  for (i = 0; i < iovcnt; i++)
     {
-      size = PGSIZE;
+      if (iov[i].iov_len > (size_t) INT32_MAX - total)
+        return false;
+      total += iov[i].iov_len;
     }
+  return true;
+}
 
-  strlcpy (retval, str, size);
-  retval[PGSIZE - 1] = '\0';
+/* Reads from FD into the IOVCNT buffers in IOV, filling each in
+   turn, and advances FD's position.  Returns the number of bytes
+   read, or -1 on error. */
+static int
+sys_readv (int fd, const struct iovec *uiov, int iovcnt)
+{
+  struct iovec iov[IOV_MAX];
 
-  return retval;
+  if (!copy_iovec (iov, uiov, iovcnt))
+    return -1;
+  return transfer_iovec (fd, iov, iovcnt, -1, false);
 }
 
-static struct file *
-get_file_by_fd (int fd)
+/* Writes the IOVCNT buffers in IOV to FD in turn and advances
+   FD's position.  Returns the number of bytes written, or -1 on
+   error. */
+static int
+sys_writev (int fd, const struct iovec *uiov, int iovcnt)
 {
-  struct thread *t = thread_current ();
-  struct list_elem *e;
-  struct fd_node *f;
+  struct iovec iov[IOV_MAX];
+
+  if (!copy_iovec (iov, uiov, iovcnt))
+    return -1;
+  return transfer_iovec (fd, iov, iovcnt, -1, true);
+}
+
+/* Reads SIZE bytes from FD at OFFSET into BUFFER without moving
+   FD's position.  Returns the number of bytes read, or -1 on
+   error. */
+static int
+sys_pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct iovec iov;
+
+  if (offset > INT32_MAX || size > INT32_MAX)
+    return -1;
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return transfer_iovec (fd, &iov, 1, offset, false);
+}
+
+/* Writes SIZE bytes from BUFFER to FD at OFFSET without moving
+   FD's position.  Returns the number of bytes written, or -1 on
+   error. */
+static int
+sys_pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  struct iovec iov;
+
+  if (offset > INT32_MAX || size > INT32_MAX)
+    return -1;
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return transfer_iovec (fd, &iov, 1, offset, true);
+}
 
+/* Reads (if WRITE is false) or writes the IOVCNT buffers in IOV
+   from or to file FD, starting at offset POS, or at the file's
+   position if POS is -1, in which case the position is advanced
+   past the bytes transferred.  All the buffers are pinned once,
+   up front, for the whole transfer.  Returns
+   the number of bytes transferred, or -1 if FD is not open for
+   the transfer.  Writes to fd 1 go to the console. */
+static int
+transfer_iovec (int fd, const struct iovec *iov, int iovcnt, off_t pos,
+                bool write)
+{
   struct file *file = NULL;
+  bool advance = pos == -1;
+  int total = 0;
+  int i;
+
+  if (fd != 1 || !write)
+    {
+      file = get_file_by_fd (fd);
+      if (file == NULL)
+        return -1;
+    }
+  else if (!advance)
+    return -1;
+
+  /* Check every buffer before pinning any, so that a bad one
+     leaves nothing pinned behind. */
+  for (i = 0; i < iovcnt; i++)
+    check_user_buffer (iov[i].iov_base, iov[i].iov_len, !write);
+  for (i = 0; i < iovcnt; i++)
+    if (!pin_user_buffer (iov[i].iov_base, iov[i].iov_len, !write))
+      {
+        while (i-- > 0)
+          unpin_user_buffer (iov[i].iov_base, iov[i].iov_len);
+        sys_exit (-1);
+      }
 
-  for (e = list_begin (&t->fd_table); e != list_end (&t->fd_table);
-       e = list_next (e))
+  if (file == NULL)
     {
-      f = list_entry (e, struct fd_node, elem);
-      if (f->fd == fd)
+      for (i = 0; i < iovcnt; i++)
         {
-          file = f->f_ptr;
+          putbuf (iov[i].iov_base, iov[i].iov_len);
+          total += iov[i].iov_len;
         }
     }
-  return file;
+  else
+    {
+      if (advance)
+        pos = file_tell (file);
+      for (i = 0; i < iovcnt; i++)
+        {
+          off_t cnt = write
+            ? file_write_at (file, iov[i].iov_base, iov[i].iov_len,
+                             pos + total)
+            : file_read_at (file, iov[i].iov_base, iov[i].iov_len,
+                            pos + total);
+          total += cnt;
+          if (cnt < (off_t) iov[i].iov_len)
+            break;
+        }
+      if (advance)
+        file_seek (file, pos + total);
+    }
+
+  for (i = 0; i < iovcnt; i++)
+    unpin_user_buffer (iov[i].iov_base, iov[i].iov_len);
+  return total;
+}
+
+/* Exits the process unless the SIZE bytes at user address UADDR
+   are mapped, and writable if WRITE.  An empty buffer is fine
+   wherever it points. */
+static void
+check_user_buffer (void *uaddr, size_t size, bool write)
+{
+  uint8_t *upage;
+
+  if (size == 0)
+    return;
+  if (!is_user_range (uaddr, size))
+    sys_exit (-1);
+  for (upage = pg_round_down (uaddr); upage < (uint8_t *) uaddr + size;
+       upage += PGSIZE)
+    {
+      uint8_t *probe = upage < (uint8_t *) uaddr ? uaddr : upage;
+      int byte = get_user (probe);
+
+      if (byte < 0 || (write && !put_user (probe, byte)))
+        sys_exit (-1);
+    }
+}
+
+/* Pins the pages of the SIZE bytes at user address UADDR,
+   faulting them in first.  Returns false, with nothing left
+   pinned, if a page cannot be brought in, such as when it is not
+   mapped or swap is full. */
+static bool
+pin_user_buffer (void *uaddr, size_t size, bool write)
+{
+  uint8_t *first = pg_round_down (uaddr);
+  uint8_t *upage;
+
+  if (size == 0)
+    return true;
+  for (upage = first; upage < (uint8_t *) uaddr + size; upage += PGSIZE)
+    if (!page_pin_frame (upage, write))
+      {
+        unpin_user_buffer (first, upage - first);
+        return false;
+      }
+  return true;
+}
+
+/* Unpins the pages pinned by pin_user_buffer(). */
+static void
+unpin_user_buffer (void *uaddr, size_t size)
+{
+  uint8_t *upage;
+
+  if (size == 0)
+    return;
+  for (upage = pg_round_down (uaddr); upage < (uint8_t *) uaddr + size;
+       upage += PGSIZE)
+    page_unpin_frame (upage);
+}
+
+/* Copies the file name at user address UFILE into FILE_PATH,
+   which has room for NAME_MAX + 2 bytes.  Exits the process if
+   UFILE is invalid.  Returns false if the name is too long to
+   name any file, so that callers fail without a lookup. */
+static bool
+copy_file_name (char *file_path, const char *ufile)
+{
+  int len = strncpy_from_user (file_path, ufile, NAME_MAX + 2);
+
+  if (len < 0)
+    sys_exit (-1);
+  return len <= NAME_MAX;
+}
+
+static struct file *
+get_file_by_fd (int fd)
+{
+  struct fd_table *ft = &thread_current ()->fd_table;
+
+  if (fd < 0 || (size_t) fd >= ft->size)
+    return NULL;
+  return ft->files[fd];
 }
 
 /* Returns a hash value for page p. */
@@ -9,13 +9,13 @@
 typedef int mapid_t;
 #endif
 
-struct semaphore file_lock;
-
-struct fd_node
+/* A process's open files, indexed by file descriptor.  Fds 0
+   and 1 are the console and are always marked in use. */
+struct fd_table
 {
-  struct list_elem elem;
-  int fd;
-  struct file* f_ptr;
+  struct file **files;          /* Open file per fd, or null. */
+  struct bitmap *used;          /* One bit per fd, set if in use. */
+  size_t size;                  /* Number of fds FILES has room for. */
 };
 
 struct mmap_table
@@ -28,5 +28,7 @@ void syscall_init (void);
 void sys_exit(int status);
 void mmap_init(struct mmap_table *mt);
 void mmap_free_all (void);
+void fd_init (struct fd_table *);
+void fd_close_all (void);
 
 #endif /* userprog/syscall.h */
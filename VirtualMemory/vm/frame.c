@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "devices/timer.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include "threads/loader.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
@@ -19,43 +21,519 @@ struct semaphore frame_lock;
 static struct frame_node *next_page;
 static int frame_cnt;
 
+/* Direct index from kernel page to frame node.  frame_map[i]
+   describes the kernel page at frame_base + i * PGSIZE. */
+static struct frame_node **frame_map;
+static uint8_t *frame_base;
+static size_t frame_map_cnt;
+
+/* Frames not backing any page, kept off the clock's path so a
+   fault can take one without scanning.  free_cnt is its length.
+   Both are protected by frame_lock. */
+static struct list free_frames;
+static size_t free_cnt;
+
+/* Page-out daemon.  Woken when free_cnt drops below
+   frame_low_mark, it evicts pages until free_cnt reaches
+   frame_high_mark. */
+static size_t frame_low_mark;
+static size_t frame_high_mark;
+static struct semaphore pageout_sema;
+static thread_func pageout_daemon NO_RETURN;
+
+/* msync flusher.  MS_ASYNC requests are queued on sync_queue,
+   protected by frame_lock, and written back by the "msync"
+   thread. */
+struct sync_request
+  {
+    struct list_elem elem;
+    void *kpage;
+    struct page_entry *page;
+  };
+static struct list sync_queue;
+static struct semaphore sync_sema;
+static thread_func sync_daemon NO_RETURN;
+
+/* Eviction statistics. */
+static long long dropped_cnt;     /* Clean pages dropped, no write. */
+static long long swap_out_cnt;    /* Pages written to swap. */
+static long long zero_out_cnt;    /* All-zero pages dropped instead. */
+static long long writeback_cnt;   /* Dirty mmap pages written to file. */
+static long long scan_cnt;        /* Frames examined by the clock. */
+static long long share_cnt;       /* Faults served by a shared frame. */
+static long long sync_cnt;        /* Pages written back by msync. */
+
+/* Frames holding pages that other processes may map, keyed by
+   (inode, offset, read_bytes, mmap).  These are executable pages
+   not yet written to, which running executables keep from
+   changing by denying writes, and pages of mapped files, which
+   every process mapping the file shares writes included.  A
+   frame is in this table only while some process maps it.
+   Frames of mapped files in it also serve as the inode's cached
+   copy of their page, so that read() and write() go to the
+   mapped memory.  Protected by frame_lock. */
+static struct hash share_table;
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+
+/* Page replacement policy.  The clock hand and the skipping of
+   free, pinned and busy frames are shared; a policy only decides,
+   for each frame the hand passes, whether to evict it now.
+
+   MAP is called when a frame is given to a new page, with
+   REFERENCED false for read-ahead that the owner has not asked
+   for yet.  SPARE is called with the frame's lock held and
+   returns true to keep the frame for now.  SWEEP counts how many
+   times the hand has gone all the way round in this search, so a
+   policy can relax its rules if it keeps finding nothing. */
+struct frame_policy
+  {
+    const char *name;
+    void (*map) (struct frame_node *, bool referenced);
+    bool (*spare) (struct frame_node *, size_t sweep);
+  };
+
+static void clock_map (struct frame_node *, bool referenced);
+static bool clock_spare (struct frame_node *, size_t sweep);
+static bool wsclock_spare (struct frame_node *, size_t sweep);
+static void clockpro_map (struct frame_node *, bool referenced);
+static bool clockpro_spare (struct frame_node *, size_t sweep);
+
+static const struct frame_policy policies[] =
+  {
+    {"clock", clock_map, clock_spare},
+    {"wsclock", clock_map, wsclock_spare},
+    {"clockpro", clockpro_map, clockpro_spare},
+  };
+static const struct frame_policy *policy = &policies[0];
+
+/* WSClock: an unreferenced page younger than this many timer
+   ticks is still in its process's working set. */
+#define WSCLOCK_WINDOW (TIMER_FREQ / 10)
+
+/* CLOCK-Pro: number of hot frames, and the most allowed. */
+static size_t hot_cnt;
+static size_t hot_max;
+
+static struct frame_node *frame_lookup (void *kpage);
+static struct frame_node *frame_pick_victim (size_t max_scan);
+static struct frame_node *frame_pick_local (struct page_entry *);
+static bool frame_try_evict (struct frame_node *, size_t sweep);
+static bool frame_caches_page (struct frame_node *);
+static void frame_set_owner (struct frame_node *, struct page_entry *);
+static void frame_release (struct frame_node *);
+static bool frame_evict (struct frame_node *, struct page_entry *);
+static bool frame_owned_by_current (struct frame_node *);
+static bool frame_referenced (struct frame_node *);
+static bool frame_split_large (struct page_entry *);
+static struct page_entry *frame_mapping_of_current (struct frame_node *);
+static void frame_unpublish (struct frame_node *);
+static bool frame_unmap_sharers (struct frame_node *);
+static void frame_drop_mapping (struct frame_node *, struct page_entry *);
+static bool frame_maps (struct frame_node *, struct page_entry *);
+static void frame_sync_now (void *, struct page_entry *);
+
+/* Takes every page in the user pool as a frame and starts the
+   page-out daemon.  LOW_MARK and HIGH_MARK are the free-frame
+   watermarks; a LOW_MARK of 0 disables the daemon. */
 void
-frame_init (void)
+frame_init (size_t low_mark, size_t high_mark)
 {
   list_init (&frame_table);
+  list_init (&free_frames);
+  hash_init (&share_table, share_hash, share_less, NULL);
   sema_init (&frame_lock, 1);
+  sema_init (&pageout_sema, 0);
+  list_init (&sync_queue);
+  sema_init (&sync_sema, 0);
   frame_cnt = 0;
+  free_cnt = 0;
 
   void *curr;
   struct frame_node *f_node;
+  uint8_t *frame_top = NULL;
 
+  frame_base = NULL;
   while ((curr = palloc_get_page (PAL_USER | PAL_ZERO)) != NULL)
     {
+      if (frame_base == NULL || (uint8_t *) curr < frame_base)
+        frame_base = curr;
+      if ((uint8_t *) curr > frame_top)
+        frame_top = curr;
+
       f_node = malloc (sizeof (struct frame_node));
       f_node->frame_id = frame_cnt;
       f_node->kpage = curr;
       f_node->upage_entry = NULL;
       f_node->used = false;
       f_node->has_chance = false;
-      sema_init(&f_node->pin, 1);
+      f_node->pin_cnt = 0;
+      f_node->last_use = 0;
+      f_node->hot = false;
+      f_node->in_test = false;
+      sema_init(&f_node->lock, 1);
+      list_init (&f_node->sharers);
+      f_node->inode = NULL;
+      f_node->dirty = false;
       list_push_back (&frame_table, &f_node->elem);
+      list_push_back (&free_frames, &f_node->free_elem);
       frame_cnt++;
+      free_cnt++;
     }
     struct list_elem *e;
     e = list_front (&frame_table);
     next_page = list_entry (e, struct frame_node, elem);
+
+    /* The user pool is normally one contiguous run, so the map is
+       dense; any holes are left null. */
+    frame_map_cnt = (frame_top - frame_base) / PGSIZE + 1;
+    frame_map = calloc (frame_map_cnt, sizeof *frame_map);
+    if (frame_map == NULL)
+      PANIC ("frame_init:: cannot allocate frame map");
+    for (e = list_begin (&frame_table); e != list_end (&frame_table); e = list_next (e))
+      {
+        f_node = list_entry (e, struct frame_node, elem);
+        frame_map[((uint8_t *) f_node->kpage - frame_base) / PGSIZE] = f_node;
+      }
+
+    /* Keep the watermarks sane for small user pools. */
+    if (high_mark > (size_t) frame_cnt / 2)
+      high_mark = frame_cnt / 2;
+    if (low_mark > high_mark)
+      low_mark = high_mark;
+    frame_low_mark = low_mark;
+    frame_high_mark = high_mark;
+    hot_cnt = 0;
+    hot_max = frame_cnt * 3 / 4;
+    if (frame_low_mark > 0)
+      thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+    thread_create ("msync", PRI_DEFAULT, sync_daemon, NULL);
+}
+
+/* Selects the page replacement policy called NAME, one of
+   "clock", "wsclock" or "clockpro".  Returns false if there is no
+   such policy.  Must be called before frame_init. */
+bool
+frame_select_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (name, policies[i].name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+  return false;
 }
 
+/* Prints eviction statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evictions without swap write, %lld swapped out, "
+          "%lld written back\n", dropped_cnt, swap_out_cnt, writeback_cnt);
+  printf ("Frames: %lld zero pages dropped instead of swapped\n",
+          zero_out_cnt);
+  printf ("Frames: %s replacement, %lld frames scanned\n",
+          policy->name, scan_cnt);
+  printf ("Frames: %lld faults served by shared frames, %lld pages synced\n",
+          share_cnt, sync_cnt);
+}
+
+/* Returns the frame node for KPAGE, or a null pointer if KPAGE
+   is not a user frame. */
+static struct frame_node *
+frame_lookup (void *kpage)
+{
+  uint8_t *k = kpage;
+
+  if (frame_map == NULL || k < frame_base || pg_ofs (k) != 0)
+    return NULL;
+  if ((size_t) (k - frame_base) / PGSIZE >= frame_map_cnt)
+    return NULL;
+  return frame_map[(k - frame_base) / PGSIZE];
+}
+
+/* Returns a frame for UPAGE_ENTRY, evicting another page if no
+   frame is free.  The frame is returned pinned.  Returns a null
+   pointer if no page could be evicted because swap is full. */
 void *
-frame_get_page (struct page_entry *upage_entry, bool pin)
+frame_get_page (struct page_entry *upage_entry)
 {
   struct frame_node *f_node;
-  struct list_elem *e;
-  struct thread *t = thread_current ();
+  struct page_entry *victim;
+  struct thread *t UNUSED = thread_current ();
+  int failures = 0;
+  bool local = page_rss_full (upage_entry, 1);
 
+  /* Only the clock hand and the free list are protected by
+     frame_lock.  Once a frame has been picked, its own lock keeps
+     other evictors away while the old contents are written out. */
   sema_down(&frame_lock);
 
   while (true)
+    {
+      victim = NULL;
+
+      /* A process at its resident set limit replaces one of its own
+         pages, unless none of them can go right now. */
+      if (local)
+        {
+          f_node = frame_pick_local (upage_entry);
+          local = f_node != NULL;
+        }
+
+      if (local)
+        victim = f_node->upage_entry;
+      else if (!list_empty (&free_frames))
+        {
+          f_node = list_entry (list_pop_front (&free_frames), struct frame_node, free_elem);
+          free_cnt--;
+          sema_down(&f_node->lock);
+          DEBUGC("[%s] frame_get_page:: frame number: %d is unused\n", t->name, f_node->frame_id);
+        }
+      else if (failures > frame_cnt)
+        {
+          sema_up(&frame_lock);
+          return NULL;
+        }
+      else
+        {
+          /* Every policy settles within a few sweeps, so coming up
+             empty means every frame is pinned or busy.  Let their
+             owners run instead of spinning on the clock. */
+          f_node = frame_pick_victim (4 * frame_cnt);
+          if (f_node == NULL)
+            {
+              sema_up(&frame_lock);
+              failures++;
+              thread_yield ();
+              sema_down(&frame_lock);
+              continue;
+            }
+          victim = f_node->upage_entry;
+        }
+
+      DEBUGB("[%s] frame_get_page:: Using frame number: %u kpage: %p\n", t->name, f_node->frame_id, f_node->kpage);
+
+      /* Hand the frame to its new owner before dropping the clock.
+         The frame stays pinned until the caller has filled it; see
+         page_fix_page. */
+      frame_set_owner (f_node, upage_entry);
+      f_node->used = true;
+      f_node->pin_cnt = 1;
+      policy->map (f_node, true);
+
+      if (free_cnt < frame_low_mark && pageout_sema.value == 0)
+        sema_up(&pageout_sema);
+      sema_up(&frame_lock);
+
+      if (victim == NULL || frame_evict (f_node, victim))
+        break;
+
+      /* VICTIM could not be evicted (swap is full, or its large
+         page could not be split): give the frame back to it and
+         try the next one. */
+      sema_down(&frame_lock);
+      frame_set_owner (f_node, victim);
+      f_node->pin_cnt = 0;
+      policy->map (f_node, true);
+      sema_up(&f_node->lock);
+      failures++;
+    }
+
+  sema_up(&f_node->lock);
+  return f_node->kpage;
+}
+
+/* Returns a free frame for UPAGE_ENTRY without evicting
+   anything, or a null pointer if none is free.  The frame is
+   returned pinned.  Used for read-ahead, which is only worth
+   doing with memory that is otherwise idle. */
+void *
+frame_get_free_page (struct page_entry *upage_entry)
+{
+  struct frame_node *f_node;
+
+  sema_down(&frame_lock);
+  if (free_cnt <= frame_low_mark || page_rss_full (upage_entry, 1))
+    {
+      sema_up(&frame_lock);
+      return NULL;
+    }
+  f_node = list_entry (list_pop_front (&free_frames), struct frame_node, free_elem);
+  free_cnt--;
+  sema_down(&f_node->lock);
+  frame_set_owner (f_node, upage_entry);
+  f_node->used = true;
+  f_node->pin_cnt = 1;
+  policy->map (f_node, false);
+  sema_up(&frame_lock);
+  sema_up(&f_node->lock);
+  return f_node->kpage;
+}
+
+/* Returns the first of CNT free frames that are physically
+   contiguous and start at a physical address that is a multiple
+   of CNT pages, giving frame I to PAGES[I], or a null pointer if
+   there is no such run.  Nothing is evicted to make room.  The
+   frames are returned pinned. */
+void *
+frame_get_free_run (struct page_entry **pages, size_t cnt)
+{
+  size_t align = cnt * PGSIZE;
+  size_t i, j;
+
+  sema_down(&frame_lock);
+  if (free_cnt < cnt + frame_low_mark || page_rss_full (pages[0], cnt))
+    {
+      sema_up(&frame_lock);
+      return NULL;
+    }
+
+  for (i = (align - vtop (frame_base) % align) % align / PGSIZE;
+       i + cnt <= frame_map_cnt; i += cnt)
+    {
+      for (j = 0; j < cnt; j++)
+        if (frame_map[i + j] == NULL || frame_map[i + j]->used)
+          break;
+      if (j == cnt)
+        break;
+    }
+  if (i + cnt > frame_map_cnt)
+    {
+      sema_up(&frame_lock);
+      return NULL;
+    }
+
+  for (j = 0; j < cnt; j++)
+    {
+      struct frame_node *f_node = frame_map[i + j];
+
+      list_remove (&f_node->free_elem);
+      free_cnt--;
+      sema_down(&f_node->lock);
+      frame_set_owner (f_node, pages[j]);
+      f_node->used = true;
+      f_node->pin_cnt = 1;
+      policy->map (f_node, true);
+      sema_up(&f_node->lock);
+    }
+  if (free_cnt < frame_low_mark && pageout_sema.value == 0)
+    sema_up(&pageout_sema);
+  sema_up(&frame_lock);
+  return frame_map[i]->kpage;
+}
+
+/* Returns the number of frames pinned for pages of the process
+   whose page directory is PD. */
+size_t
+frame_pinned_cnt (uint32_t *pd)
+{
+  struct list_elem *e;
+  size_t cnt = 0;
+
+  for (e = list_begin (&frame_table); e != list_end (&frame_table); e = list_next (e))
+    {
+      struct frame_node *f_node = list_entry (e, struct frame_node, elem);
+
+      sema_down(&f_node->lock);
+      if (f_node->used && f_node->pin_cnt > 0 && f_node->upage_entry != NULL
+          && f_node->upage_entry->pagedir == pd)
+        cnt++;
+      sema_up(&f_node->lock);
+    }
+  return cnt;
+}
+
+/* Makes P the page that F_NODE holds, moving F_NODE to the
+   resident frame list of P's process, or just off its old
+   owner's list if P is null.  The caller must hold frame_lock. */
+static void
+frame_set_owner (struct frame_node *f_node, struct page_entry *p)
+{
+  if (f_node->upage_entry != NULL)
+    list_remove (&f_node->owner_elem);
+  f_node->upage_entry = p;
+  if (p != NULL)
+    list_push_back (page_frames (p), &f_node->owner_elem);
+}
+
+/* Returns true, with F_NODE's lock held, if F_NODE may be evicted
+   now and the replacement policy agrees to evict it on sweep
+   SWEEP of the clock.  Free, pinned and busy frames are skipped.
+   The caller must hold frame_lock. */
+static bool
+frame_try_evict (struct frame_node *f_node, size_t sweep)
+{
+  struct thread *t UNUSED = thread_current ();
+
+  if (!sema_try_down(&f_node->lock))
+    return false;
+
+  if (f_node->pin_cnt > 0 || !f_node->used)
+    {
+      sema_up (&f_node->lock);
+      return false;
+    }
+
+  if (policy->spare (f_node, sweep))
+    {
+      DEBUGC("[%s] frame_try_evict:: frame number: %d spared\n", t->name, f_node->frame_id);
+      sema_up (&f_node->lock);
+      return false;
+    }
+
+  DEBUGC("[%s] frame_try_evict:: frame number: %d chosen\n", t->name, f_node->frame_id);
+  if (f_node->hot)
+    {
+      f_node->hot = false;
+      hot_cnt--;
+    }
+  return true;
+}
+
+/* Picks one of the resident frames of the process that P belongs
+   to for P's process to replace, running the clock over that
+   process's own frame list rather than the whole frame table.
+   Returns the frame with its lock held, or a null pointer if none
+   can go right now.  The caller must hold frame_lock. */
+static struct frame_node *
+frame_pick_local (struct page_entry *p)
+{
+  struct list *frames = page_frames (p);
+  size_t cnt = list_size (frames);
+  size_t scanned;
+
+  for (scanned = 0; scanned < 4 * cnt; scanned++)
+    {
+      /* The front of the list is the hand; frames it passes go to
+         the back. */
+      struct frame_node *f_node = list_entry (list_pop_front (frames),
+                                              struct frame_node, owner_elem);
+      list_push_back (frames, &f_node->owner_elem);
+      scan_cnt++;
+
+      if (frame_try_evict (f_node, scanned / cnt))
+        return f_node;
+    }
+  return NULL;
+}
+
+/* Advances the clock hand until the replacement policy agrees
+   to evict the frame under it.  Returns the frame with its lock
+   held, or a null pointer if MAX_SCAN frames were examined
+   without finding one.
+   The caller must hold frame_lock. */
+static struct frame_node *
+frame_pick_victim (size_t max_scan)
+{
+  struct frame_node *f_node;
+  struct list_elem *e;
+  size_t scanned;
+
+  for (scanned = 0; scanned < max_scan; scanned++)
     {
       f_node = next_page;
       e = list_next (&f_node->elem);
@@ -64,198 +542,830 @@ frame_get_page (struct page_entry *upage_entry, bool pin)
           e = list_front (&frame_table);
         }
       next_page = list_entry (e, struct frame_node, elem);
+      scan_cnt++;
+
+      if (frame_try_evict (f_node, scanned / frame_cnt))
+        return f_node;
+    }
+  return NULL;
+}
 
-      if (!sema_try_down(&f_node->pin))
+/* Returns true if F_NODE's page was referenced since the last
+   call, and clears its reference bits.  A frame that was just
+   given to a faulting page counts as referenced once even though
+   the owner has not touched it yet.  A page still mapped by a
+   4 MB page, whose accessed bit stands for all of its pages,
+   counts as referenced; see frame_split_large. */
+static bool
+frame_referenced (struct frame_node *f_node)
+{
+  struct page_entry *p = f_node->upage_entry;
+  bool referenced;
+  struct list_elem *e;
+
+  if (!frame_split_large (p))
+    return true;
+  referenced = f_node->has_chance
+               || pagedir_is_accessed (p->pagedir, p->upage);
+  f_node->has_chance = false;
+  pagedir_set_accessed (p->pagedir, p->upage, false);
+  for (e = list_begin (&f_node->sharers); e != list_end (&f_node->sharers);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page_entry, share_elem);
+      if (pagedir_is_accessed (p->pagedir, p->upage))
+        referenced = true;
+      pagedir_set_accessed (p->pagedir, p->upage, false);
+    }
+  return referenced;
+}
+
+/* Splits the 4 MB page that maps P, if any, so that P's pages
+   age one by one.  Returns false if P is still mapped by a large
+   page, because its page table lock is busy or memory for the
+   split is short.  The caller must hold the lock of P's frame. */
+static bool
+frame_split_large (struct page_entry *p)
+{
+  bool split;
+
+  if (!pagedir_is_large_page (p->pagedir, p->upage))
+    return true;
+  if (!sema_try_down (p->lock_p))
+    return false;
+  split = pagedir_split_large (p->pagedir, p->upage);
+  sema_up (p->lock_p);
+  return split;
+}
+
+/* CLOCK: second chance on the accessed bit. */
+static void
+clock_map (struct frame_node *f_node, bool referenced)
+{
+  f_node->has_chance = referenced;
+  f_node->last_use = timer_ticks ();
+}
+
+static bool
+clock_spare (struct frame_node *f_node, size_t sweep UNUSED)
+{
+  return frame_referenced (f_node);
+}
+
+/* WSClock: like CLOCK, but an unreferenced page is also kept
+   while it was last used less than WSCLOCK_WINDOW ticks ago, so
+   that the working sets of running processes survive a burst of
+   faults from another one.  If a whole sweep finds only working
+   set pages, the oldest-looking ones go on the next. */
+static bool
+wsclock_spare (struct frame_node *f_node, size_t sweep)
+{
+  int64_t now = timer_ticks ();
+
+  if (frame_referenced (f_node))
+    {
+      f_node->last_use = now;
+      return true;
+    }
+  return sweep == 0 && now - f_node->last_use < WSCLOCK_WINDOW;
+}
+
+/* CLOCK-Pro, without the non-resident history: pages start cold
+   and in their test period.  A cold page referenced again during
+   its test period becomes hot, as long as hot pages take up no
+   more than hot_max frames.  The hand demotes hot pages that were
+   not referenced since it last passed and evicts cold pages that
+   were not, so pages touched only once never push out the ones
+   that are reused. */
+static void
+clockpro_map (struct frame_node *f_node, bool referenced)
+{
+  if (f_node->hot)
+    {
+      f_node->hot = false;
+      hot_cnt--;
+    }
+  f_node->in_test = true;
+  clock_map (f_node, referenced);
+}
+
+static bool
+clockpro_spare (struct frame_node *f_node, size_t sweep)
+{
+  bool referenced = frame_referenced (f_node);
+
+  if (f_node->hot)
+    {
+      if (!referenced)
         {
-          continue;
+          f_node->hot = false;
+          f_node->in_test = false;
+          hot_cnt--;
         }
+      return true;
+    }
 
-      if (!f_node->used)
+  if (referenced)
+    {
+      if (f_node->in_test && hot_cnt < hot_max)
         {
-          DEBUGC("[%s] frame_get_page:: frame number: %d is unused\n", t->name, f_node->frame_id);
-          break;
+          f_node->hot = true;
+          hot_cnt++;
         }
+      else
+        f_node->in_test = true;
+      return true;
+    }
+
+  /* Leave a cold page alone until the end of its test period on
+     the first sweep. */
+  if (sweep == 0 && f_node->in_test)
+    {
+      f_node->in_test = false;
+      return true;
+    }
+  return false;
+}
+
+/* Marks F_NODE unused and puts it on the free list.  The caller
+   must hold F_NODE's lock but not frame_lock. */
+static void
+frame_release (struct frame_node *f_node)
+{
+  f_node->pin_cnt = 0;
+  f_node->dirty = false;
+
+  frame_unpublish (f_node);
+  sema_down(&frame_lock);
+  frame_set_owner (f_node, NULL);
+  /* Cleared under frame_lock, so that frame_get_free_run can tell
+     free frames by this flag. */
+  f_node->used = false;
+  if (f_node->hot)
+    {
+      f_node->hot = false;
+      hot_cnt--;
+    }
+  list_push_back (&free_frames, &f_node->free_elem);
+  free_cnt++;
+  sema_up(&frame_lock);
+}
+
+/* Page-out daemon.  Sleeps until frame_get_page notices that free
+   frames are scarce, then evicts pages with the same clock as the
+   fault path until the high watermark is reached, so that most
+   faults can take a free frame without waiting for a write. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  struct frame_node *f_node;
+  struct page_entry *victim;
+
+  for (;;)
+    {
+      sema_down(&pageout_sema);
 
-      if (f_node->has_chance)
+      while (true)
         {
-          DEBUGC("[%s] frame_get_page:: frame number: %d is used but has a chance\n", t->name, f_node->frame_id);
-          bool accessed = pagedir_is_accessed (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
-          if (accessed)
+          sema_down(&frame_lock);
+          if (free_cnt >= frame_high_mark)
             {
-              DEBUGC("[%s] frame_get_page:: frame number: %d was recently accessed, moving to back\n", t->name, f_node->frame_id);
-              list_remove (&f_node->elem);
-              f_node->has_chance = false;
-              list_push_back (&frame_table, &f_node->elem);
-              sema_up (&f_node->pin);
+              sema_up(&frame_lock);
+              break;
             }
-          else
+
+          /* Give up for now if one sweep finds nothing evictable. */
+          f_node = frame_pick_victim (2 * frame_cnt);
+          sema_up(&frame_lock);
+          if (f_node == NULL)
+            break;
+
+          DEBUGB("pageout_daemon:: evicting frame number: %u\n", f_node->frame_id);
+          victim = f_node->upage_entry;
+          if (!frame_evict (f_node, victim))
             {
-              DEBUGC("[%s] frame_get_page:: frame number: %d was NOT recently accessed, using\n", t->name, f_node->frame_id);
+              /* Swap or kernel memory is short; leave the rest to
+                 the fault path. */
+              sema_up(&f_node->lock);
               break;
             }
-        }
-      else
-        {
-          DEBUGC("[%s] frame_get_page:: frame number: %d has no second chance, using\n", t->name, f_node->frame_id);
-          break;
+          frame_release (f_node);
+          sema_up(&f_node->lock);
         }
     }
+}
 
+/* Writes the contents of F_NODE's frame back to wherever VICTIM
+   reloads from, and unmaps it from VICTIM's page directory.
+   Returns false, leaving VICTIM mapped, if VICTIM had to go to
+   swap and swap is full, or if it is part of a 4 MB page that
+   could not be split.  The caller must hold F_NODE's lock but
+   not frame_lock. */
+static bool
+frame_evict (struct frame_node *f_node, struct page_entry *victim)
+{
+  struct thread *t UNUSED = thread_current ();
 
-  DEBUGB("[%s] frame_get_page:: Using frame number: %u kpage: %p\n", t->name, f_node->frame_id, f_node->kpage);
+  /* The other processes sharing the frame lose their mappings
+     and fault the page back in from the file.  Only mapped file
+     pages can have been written through them, and those are
+     written back below like VICTIM's own writes. */
+  frame_unpublish (f_node);
+  bool shared_dirty = frame_unmap_sharers (f_node) || f_node->dirty;
+  f_node->dirty = false;
 
+  sema_down(victim->lock_p);
 
-  if (f_node->used)
+  /* Unmap first so the owner faults, and then waits on its page
+     table lock, instead of writing to the frame mid-copy.  A page
+     of a 4 MB page that cannot be split for lack of memory stays
+     where it is. */
+  if (!pagedir_clear_page (victim->pagedir, victim->upage))
     {
-      sema_down(f_node->upage_entry->lock_p);
-      bool dirty = pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
+      f_node->dirty = shared_dirty;
+      sema_up(victim->lock_p);
+      return false;
+    }
+  bool dirty = pagedir_is_dirty (victim->pagedir, victim->upage)
+               || (victim->mmap && shared_dirty);
 
-      if (!f_node->upage_entry->mmap && !f_node->upage_entry->stack)
+  if (!victim->mmap && !victim->stack)
+    {
+      if (!victim->force_swap && dirty)
         {
-          if (!f_node->upage_entry->force_swap && dirty)
-            {
-              DEBUGB("***** [%s] frame_get_page:: changing %p to swap only\n", t->name, f_node->upage_entry->upage);
-              f_node->upage_entry->force_swap = true;
-            }
+          DEBUGB("***** [%s] frame_get_page:: changing %p to swap only\n", t->name, victim->upage);
+          victim->force_swap = true;
         }
+    }
 
-      DEBUGB("[%s] frame_get_page:: old page: %p dirty: %d stack: %d writable: %d force_swap: %d\n", t->name, f_node->upage_entry->upage, dirty,
-          f_node->upage_entry->stack, f_node->upage_entry->writable, f_node->upage_entry->force_swap);
+  DEBUGB("[%s] frame_get_page:: old page: %p dirty: %d stack: %d writable: %d force_swap: %d\n", t->name, victim->upage, dirty,
+      victim->stack, victim->writable, victim->force_swap);
 
-      if (f_node->upage_entry->mmap && dirty)
+  if (victim->mmap)
+    {
+      if (dirty)
         {
-          DEBUGB("[%s] frame_get_page:: dumping page back to file: upage: %p\n", t->name, f_node->upage_entry->upage);
-          file_write_at(f_node->upage_entry->file, f_node->upage_entry->upage, f_node->upage_entry->read_bytes, f_node->upage_entry->start_offset);
-          f_node->upage_entry->kpage = NULL;
-          pagedir_clear_page (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
+          DEBUGB("[%s] frame_get_page:: dumping page back to file: upage: %p\n", t->name, victim->upage);
+          file_write_at(victim->file, f_node->kpage, victim->read_bytes, victim->start_offset);
+          writeback_cnt++;
+          page_stats (victim)->writebacks++;
         }
-
-      else //if (dirty || f_node->upage_entry->force_swap)
+      else
+        dropped_cnt++;
+    }
+  else if (dirty || victim->force_swap)
+    {
+      victim->swap_num = swap_dump_page (f_node->kpage, page_swap_hint (victim));
+      if (victim->swap_num == SWAP_ZERO)
         {
-          f_node->upage_entry->swap_num = swap_dump_page (f_node->kpage);
-          f_node->upage_entry->kpage = NULL;
-          pagedir_clear_page (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
+          /* Nothing stored; page_fix_page zero-fills it. */
+          victim->swap_num = -1;
+          victim->zero_page = true;
+          zero_out_cnt++;
         }
-      sema_up(f_node->upage_entry->lock_p);
+      else if (victim->swap_num == SWAP_ERROR)
+        {
+          DEBUGB("[%s] frame_get_page:: swap full, keeping upage: %p\n", t->name, victim->upage);
+          pagedir_set_page (victim->pagedir, victim->upage, f_node->kpage, victim->writable);
+          sema_up(victim->lock_p);
+          return false;
+        }
+      else
+        {
+          swap_out_cnt++;
+          page_stats (victim)->swap_outs++;
+        }
+    }
+  else
+    {
+      /* Clean code, data or zero page: page_fix_page will read it
+         back from victim->file (or zero it) on the next fault. */
+      DEBUGB("[%s] frame_get_page:: dropping clean page: upage: %p\n", t->name, victim->upage);
+      dropped_cnt++;
     }
+  victim->kpage = NULL;
+  victim->shared = false;
+  page_stats (victim)->resident--;
+  sema_up(victim->lock_p);
+  return true;
+}
 
-  f_node->upage_entry = upage_entry;
+/* Returns true if F_NODE currently backs a page of the running
+   process.  A frame can be stolen by another process's eviction
+   between the time a caller reads a page's kpage and the time it
+   gets the frame's lock. */
+static bool
+frame_owned_by_current (struct frame_node *f_node)
+{
+  return frame_mapping_of_current (f_node) != NULL;
+}
 
-  f_node->used = true;
-  f_node->has_chance = true;
-  if (!pin && f_node->pin.value == 0)
-    sema_up(&f_node->pin);
+/* Returns the running process's page that F_NODE backs, or a null
+   pointer.  The caller must hold F_NODE's lock. */
+static struct page_entry *
+frame_mapping_of_current (struct frame_node *f_node)
+{
+  struct semaphore *lock = &thread_current ()->page_table.lock;
+  struct list_elem *e;
 
-  DEBUGB("[%s] frame_get_page:: checking pin after setup: %d\n", t->name, f_node->pin.value);
-  sema_up(&frame_lock);
-  return f_node->kpage;
+  if (!f_node->used || f_node->upage_entry == NULL)
+    return NULL;
+  if (f_node->upage_entry->lock_p == lock)
+    return f_node->upage_entry;
+  for (e = list_begin (&f_node->sharers); e != list_end (&f_node->sharers);
+       e = list_next (e))
+    {
+      struct page_entry *p = list_entry (e, struct page_entry, share_elem);
+      if (p->lock_p == lock)
+        return p;
+    }
+  return NULL;
 }
 
 void
 frame_free_page (void *kpage)
 {
   struct frame_node *f_node = NULL;
-  struct list_elem *e;
   struct thread *t = thread_current ();
 
+  f_node = frame_lookup (kpage);
+  if (f_node == NULL)
+    return;
+
+retry:
+  sema_down(&f_node->lock);
+  struct page_entry *p = frame_mapping_of_current (f_node);
+  if (p == NULL)
+    {
+      sema_up(&f_node->lock);
+      return;
+    }
+  if (p != f_node->upage_entry || !list_empty (&f_node->sharers))
+    {
+      /* Other processes still map this frame. */
+      frame_drop_mapping (f_node, p);
+      sema_up(&f_node->lock);
+      return;
+    }
+
+  sema_down(f_node->upage_entry->lock_p);
+  if (!pagedir_split_large (p->pagedir, p->upage))
+    {
+      /* Unmapping one page of a 4 MB page takes a page table.
+         Wait for kernel memory rather than free a frame that is
+         still mapped. */
+      sema_up(f_node->upage_entry->lock_p);
+      sema_up(&f_node->lock);
+      thread_yield ();
+      goto retry;
+    }
+  DEBUGB("[%s] frame_free_page:: old page: %p dirty: %d\n", t->name, f_node->upage_entry->upage, pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage));
+  bool dirty = pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage)
+               || f_node->dirty;
+  if (f_node->upage_entry->mmap && f_node->upage_entry->writable && dirty)
+    {
+      DEBUGB("[%s] frame_free_page:: dumping page back to file: upage: %p\n", t->name, f_node->upage_entry->upage);
+      file_write_at(f_node->upage_entry->file, f_node->kpage, f_node->upage_entry->read_bytes, f_node->upage_entry->start_offset);
+      page_stats (f_node->upage_entry)->writebacks++;
+    }
+  f_node->upage_entry->kpage = NULL;
+  f_node->upage_entry->shared = false;
+  page_stats (f_node->upage_entry)->resident--;
+  pagedir_clear_page (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
+  sema_up(f_node->upage_entry->lock_p);
+
+  frame_release (f_node);
+
+  DEBUGB("[%s] frame_free_page:: frame %u released\n", t->name, f_node->frame_id);
+  sema_up(&f_node->lock);
+}
+
+/* Adds a pin to the frame at KPAGE, if the running process maps
+   it, so that it is not evicted until frame_unpin_frame() is
+   called as often.  Pins from different processes sharing the
+   frame add up.  Returns false if the frame is no longer ours. */
+bool frame_pin_frame (void *kpage)
+{
+  struct frame_node *f_node = NULL;
+  struct thread *t = thread_current ();
+  bool success = false;
+  DEBUGB("[%s] frame_pin_frame:: pinning frame %p\n", t->name, kpage);
+
+  f_node = frame_lookup (kpage);
+  if (f_node == NULL)
+    return false;
+
+  sema_down(&f_node->lock);
+  if (frame_owned_by_current (f_node))
+    {
+      f_node->pin_cnt++;
+      success = true;
+    }
+  DEBUGB("[%s] frame_pin_frame:: frame found, pinned: %d\n", t->name, success);
+  sema_up(&f_node->lock);
+  return success;
+}
+
+/* Drops one pin from the frame at KPAGE.  The frame must be
+   pinned. */
+void frame_unpin_frame (void *kpage)
+{
+  struct frame_node *f_node = NULL;
+  struct thread *t = thread_current ();
+  DEBUGB("[%s] frame_unpin_frame:: unpinning frame %p\n", t->name, kpage);
+
+  f_node = frame_lookup (kpage);
+  if (f_node == NULL)
+    return;
+
+  sema_down(&f_node->lock);
+  ASSERT (f_node->pin_cnt > 0);
+  f_node->pin_cnt--;
+  DEBUGB("[%s] frame_unpin_frame:: frame %u unpinned\n", t->name, f_node->frame_id);
+  sema_up(&f_node->lock);
+}
+
+/* Maps a frame that already holds P's page of INODE into P's
+   process: read-only for executable pages, as P's mapping allows
+   for mapped files.  Returns false if no other process has the
+   page in memory. */
+bool
+frame_map_shared (struct page_entry *p, struct inode *inode)
+{
+  struct frame_node key, *f_node;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.offset = p->start_offset;
+  key.read_bytes = p->read_bytes;
+  key.mmap = p->mmap;
+
   sema_down(&frame_lock);
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); e = list_next (e)) {
-    f_node = list_entry (e, struct frame_node, elem);
-    if (f_node->kpage == kpage)
-      {
-        break;
-      }
-  }
+  e = hash_find (&share_table, &key.share_elem);
+  if (e == NULL)
+    {
+      sema_up(&frame_lock);
+      return false;
+    }
+  f_node = hash_entry (e, struct frame_node, share_elem);
 
-  if (e == list_end (&frame_table))
+  /* Whoever holds the lock may be evicting the frame. */
+  if (!sema_try_down(&f_node->lock))
     {
       sema_up(&frame_lock);
-      return;
+      return false;
+    }
+  sema_up(&frame_lock);
+
+  /* A frame is shared by processes, not by two mappings of the
+     same file in one process, so that it is always clear which of
+     a process's pages a frame backs. */
+  if (frame_mapping_of_current (f_node) != NULL)
+    {
+      sema_up(&f_node->lock);
+      return false;
+    }
+
+  sema_down(p->lock_p);
+  p->kpage = f_node->kpage;
+  p->shared = true;
+  page_stats (p)->resident++;
+  pagedir_set_page (p->pagedir, p->upage, f_node->kpage, p->mmap && p->writable);
+  sema_up(p->lock_p);
+  list_push_back (&f_node->sharers, &p->share_elem);
+  share_cnt++;
+
+  sema_up(&f_node->lock);
+  return true;
+}
+
+/* Lets other processes map KPAGE, which holds its page's data
+   as read from INODE, instead of reading the page again.  Does
+   nothing if another frame already holds the same page. */
+void
+frame_share (void *kpage, struct inode *inode)
+{
+  struct frame_node *f_node = frame_lookup (kpage);
+
+  if (f_node == NULL)
+    return;
+
+  sema_down(&f_node->lock);
+  if (f_node->used && f_node->inode == NULL && f_node->upage_entry->kpage == kpage)
+    {
+      f_node->inode = inode;
+      f_node->offset = f_node->upage_entry->start_offset;
+      f_node->read_bytes = f_node->upage_entry->read_bytes;
+      f_node->mmap = f_node->upage_entry->mmap;
+      bool cached = (frame_caches_page (f_node)
+                     && inode_map_page (inode, f_node->offset / PGSIZE, kpage));
+
+      /* Take the place of the page in the cache before anyone
+         else can map the frame and write to it. */
+      sema_down(&frame_lock);
+      if (hash_insert (&share_table, &f_node->share_elem) != NULL)
+        f_node->inode = NULL;
+      sema_up(&frame_lock);
+
+      if (f_node->inode == NULL && cached)
+        inode_unmap_page (inode, f_node->offset / PGSIZE, kpage);
     }
+  sema_up(&f_node->lock);
+}
 
-  sema_try_down(&f_node->pin);
+/* If P is the only page mapping KPAGE, stops sharing KPAGE so
+   that P can write to it in place, pins it and returns true.
+   Otherwise returns false. */
+bool
+frame_make_private (void *kpage, struct page_entry *p)
+{
+  struct frame_node *f_node = frame_lookup (kpage);
+  bool success = false;
+
+  if (f_node == NULL)
+    return false;
 
-  if (f_node->used)
+  sema_down(&f_node->lock);
+  if (f_node->used && f_node->upage_entry == p && list_empty (&f_node->sharers))
     {
-      sema_down(f_node->upage_entry->lock_p);
-      DEBUGB("[%s] frame_free_page:: old page: %p dirty: %d\n", t->name, f_node->upage_entry->upage, pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage));
-      bool dirty = pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
-      if (f_node->upage_entry->mmap && f_node->upage_entry->writable && dirty)
+      /* Processes that unmapped the file wrote to it through this
+         frame; P's own writes stay with P. */
+      if (p->mmap && f_node->dirty)
         {
-          DEBUGB("[%s] frame_free_page:: dumping page back to file: upage: %p\n", t->name, f_node->upage_entry->upage);
-          file_write_at(f_node->upage_entry->file, f_node->upage_entry->upage, f_node->upage_entry->read_bytes, f_node->upage_entry->start_offset);
-          f_node->upage_entry->kpage = NULL;
-          pagedir_clear_page (f_node->upage_entry->pagedir, f_node->upage_entry->upage);
+          file_write_at (p->file, kpage, p->read_bytes, p->start_offset);
+          writeback_cnt++;
         }
-      sema_up(f_node->upage_entry->lock_p);
+      f_node->dirty = false;
+      frame_unpublish (f_node);
+      f_node->pin_cnt++;
+      success = true;
     }
+  sema_up(&f_node->lock);
+  return success;
+}
 
+/* Copies OLD_KPAGE, which P shares with other processes, to
+   NEW_KPAGE and removes P's mapping of OLD_KPAGE.  Returns false
+   without copying if P no longer maps OLD_KPAGE because it was
+   evicted in the meantime. */
+bool
+frame_copy_unshare (void *old_kpage, struct page_entry *p, void *new_kpage)
+{
+  struct frame_node *f_node = frame_lookup (old_kpage);
 
-  f_node->upage_entry = NULL;
+  if (f_node == NULL)
+    return false;
 
-  f_node->used = false;
+  sema_down(&f_node->lock);
+  if (frame_mapping_of_current (f_node) != p)
+    {
+      sema_up(&f_node->lock);
+      return false;
+    }
+  memcpy (new_kpage, old_kpage, PGSIZE);
+  if (p == f_node->upage_entry && list_empty (&f_node->sharers))
+    {
+      if (p->mmap && f_node->dirty)
+        {
+          file_write_at (p->file, old_kpage, p->read_bytes, p->start_offset);
+          writeback_cnt++;
+          page_stats (p)->writebacks++;
+        }
+      sema_down(p->lock_p);
+      pagedir_clear_page (p->pagedir, p->upage);
+      p->kpage = NULL;
+      p->shared = false;
+      page_stats (p)->resident--;
+      sema_up(p->lock_p);
+      frame_release (f_node);
+    }
+  else
+    frame_drop_mapping (f_node, p);
+  sema_up(&f_node->lock);
+  return true;
+}
+
+/* Removes F_NODE from the table of shared frames, so that no new
+   process maps it.  The caller must hold F_NODE's lock but not
+   frame_lock. */
+static void
+frame_unpublish (struct frame_node *f_node)
+{
+  struct inode *inode = f_node->inode;
 
-  DEBUGB("[%s] frame_free_page:: frame found, sema: %d\n", t->name, f_node->pin.value);
-  if (f_node->pin.value == 0)
-    sema_up(&f_node->pin);
+  if (inode == NULL)
+    return;
+  sema_down(&frame_lock);
+  hash_delete (&share_table, &f_node->share_elem);
+  f_node->inode = NULL;
   sema_up(&frame_lock);
+
+  if (frame_caches_page (f_node))
+    inode_unmap_page (inode, f_node->offset / PGSIZE, f_node->kpage);
 }
 
+/* Returns true if shared frame F_NODE holds a whole page of a
+   mapped file, exactly as the file has it, and so can stand in
+   for that page in the inode's cache.  Executable pages are
+   zero-filled past their segment instead. */
+static bool
+frame_caches_page (struct frame_node *f_node)
+{
+  return f_node->mmap && f_node->offset % PGSIZE == 0;
+}
 
-void frame_pin_frame (void *kpage)
+/* Unmaps F_NODE from every page sharing it except upage_entry.
+   Returns true if any of them had written to it.  The caller
+   must hold F_NODE's lock. */
+static bool
+frame_unmap_sharers (struct frame_node *f_node)
 {
-  struct frame_node *f_node = NULL;
-  struct list_elem *e;
-  struct thread *t = thread_current ();
-  DEBUGB("[%s] frame_pin_frame:: pinning frame %p\n", t->name, kpage);
+  bool dirty = false;
 
-  sema_down(&frame_lock);
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); e = list_next (e)) {
-    f_node = list_entry (e, struct frame_node, elem);
-    if (f_node->kpage == kpage)
-      {
-        break;
-      }
-  }
+  while (!list_empty (&f_node->sharers))
+    {
+      struct page_entry *p = list_entry (list_pop_front (&f_node->sharers),
+                                         struct page_entry, share_elem);
+      sema_down(p->lock_p);
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (pagedir_is_dirty (p->pagedir, p->upage))
+        dirty = true;
+      p->kpage = NULL;
+      p->shared = false;
+      page_stats (p)->resident--;
+      sema_up(p->lock_p);
+    }
+  return dirty;
+}
 
-  if (e == list_end (&frame_table))
+/* Unmaps F_NODE from P, one of several pages sharing it.  The
+   caller must hold F_NODE's lock. */
+static void
+frame_drop_mapping (struct frame_node *f_node, struct page_entry *p)
+{
+  ASSERT (p != f_node->upage_entry || !list_empty (&f_node->sharers));
+
+  if (p == f_node->upage_entry)
     {
+      struct page_entry *heir = list_entry (list_pop_front (&f_node->sharers),
+                                            struct page_entry, share_elem);
+      sema_down(&frame_lock);
+      frame_set_owner (f_node, heir);
       sema_up(&frame_lock);
+    }
+  else
+    list_remove (&p->share_elem);
+
+  sema_down(p->lock_p);
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (pagedir_is_dirty (p->pagedir, p->upage))
+    f_node->dirty = true;
+  p->kpage = NULL;
+  p->shared = false;
+  page_stats (p)->resident--;
+  sema_up(p->lock_p);
+}
+
+/* Returns a hash value for the page held by shared frame F_. */
+static unsigned
+share_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame_node *f = hash_entry (f_, struct frame_node, share_elem);
+  unsigned h = hash_bytes (&f->inode, sizeof f->inode);
+
+  h = h * 31 + hash_int (f->offset);
+  h = h * 31 + hash_int (f->read_bytes);
+  return h * 31 + f->mmap;
+}
+
+/* Returns true if shared frame A's page precedes B's. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame_node *a = hash_entry (a_, struct frame_node, share_elem);
+  const struct frame_node *b = hash_entry (b_, struct frame_node, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->offset != b->offset)
+    return a->offset < b->offset;
+  if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  return a->mmap < b->mmap;
+}
+
+/* Writes KPAGE, which backs P, a page of a mapped file in the
+   running process, back to the file if any process mapping it
+   wrote to it since it was last written back, and clears the
+   dirty bits.  If ASYNC is true, queues the write for the msync
+   thread instead. */
+void
+frame_sync (void *kpage, struct page_entry *p, bool async)
+{
+  struct sync_request *r;
+
+  if (async && (r = malloc (sizeof *r)) != NULL)
+    {
+      r->kpage = kpage;
+      r->page = p;
+      sema_down(&frame_lock);
+      list_push_back (&sync_queue, &r->elem);
+      sema_up(&frame_lock);
+      sema_up(&sync_sema);
       return;
     }
+  frame_sync_now (kpage, p);
+}
 
+/* msync thread.  Writes back the pages queued by frame_sync. */
+static void
+sync_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct sync_request *r;
 
-  if (f_node->pin.value == 1)
-    sema_down(&f_node->pin);
-  DEBUGB("[%s] frame_pin_frame:: frame found, after change pin: %d\n", t->name, f_node->pin.value);
-  sema_up(&frame_lock);
+      sema_down(&sync_sema);
+      sema_down(&frame_lock);
+      r = list_entry (list_pop_front (&sync_queue), struct sync_request, elem);
+      sema_up(&frame_lock);
+
+      frame_sync_now (r->kpage, r->page);
+      free (r);
+    }
 }
 
-void frame_unpin_frame (void *kpage)
+/* Does the work of frame_sync.  P is only compared with the pages
+   mapping KPAGE before being used, since by the time a queued
+   request runs it may have been unmapped and freed. */
+static void
+frame_sync_now (void *kpage, struct page_entry *p)
 {
-  struct frame_node *f_node = NULL;
+  struct frame_node *f_node = frame_lookup (kpage);
   struct list_elem *e;
-  struct thread *t = thread_current ();
-  DEBUGB("[%s] frame_unpin_frame:: unpinning frame %p\n", t->name, kpage);
+  bool dirty;
 
-  sema_down(&frame_lock);
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); e = list_next (e)) {
-    f_node = list_entry (e, struct frame_node, elem);
-    if (f_node->kpage == kpage)
-      {
-        break;
-      }
-  }
+  if (f_node == NULL)
+    return;
 
-  if (e == list_end (&frame_table))
+  sema_down(&f_node->lock);
+  if (!frame_maps (f_node, p))
     {
-      sema_up(&frame_lock);
+      sema_up(&f_node->lock);
       return;
     }
 
+  /* P's page table lock keeps close() from closing P's file while
+     it is being written. */
+  sema_down(p->lock_p);
+  if (p->mmap && p->kpage == kpage)
+    {
+      /* Clear the dirty bits first: a write racing with the file
+         write sets them again and is caught by the next sync. */
+      dirty = f_node->dirty;
+      f_node->dirty = false;
+      if (pagedir_is_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage))
+        {
+          dirty = true;
+          pagedir_set_dirty (f_node->upage_entry->pagedir, f_node->upage_entry->upage, false);
+        }
+      for (e = list_begin (&f_node->sharers); e != list_end (&f_node->sharers);
+           e = list_next (e))
+        {
+          struct page_entry *s = list_entry (e, struct page_entry, share_elem);
+          if (pagedir_is_dirty (s->pagedir, s->upage))
+            {
+              dirty = true;
+              pagedir_set_dirty (s->pagedir, s->upage, false);
+            }
+        }
 
-  if (f_node->pin.value == 0)
-    sema_up(&f_node->pin);
-  DEBUGB("[%s] frame_unpin_frame:: frame found, after chance pin: %d\n", t->name, f_node->pin.value);
-  sema_up(&frame_lock);
+      if (dirty)
+        {
+          file_write_at (p->file, kpage, p->read_bytes, p->start_offset);
+          sync_cnt++;
+          page_stats (p)->writebacks++;
+        }
+    }
+  sema_up(p->lock_p);
+  sema_up(&f_node->lock);
+}
+
+/* Returns true if P is one of the pages F_NODE backs.  The caller
+   must hold F_NODE's lock. */
+static bool
+frame_maps (struct frame_node *f_node, struct page_entry *p)
+{
+  struct list_elem *e;
+
+  if (!f_node->used || f_node->upage_entry == NULL)
+    return false;
+  if (f_node->upage_entry == p)
+    return true;
+  for (e = list_begin (&f_node->sharers); e != list_end (&f_node->sharers);
+       e = list_next (e))
+    if (list_entry (e, struct page_entry, share_elem) == p)
+      return true;
+  return false;
 }
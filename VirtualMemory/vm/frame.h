@@ -1,6 +1,7 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
 #include <list.h>
 #include "threads/thread.h"
 #include "vm/page.h"
@@ -11,21 +12,66 @@ struct frame_node
   unsigned frame_id;
 
   struct list_elem elem;
+  struct list_elem free_elem;
   void *kpage;
 
   //which page_entry has this frame
   struct page_entry *upage_entry;
 
+  //in the resident frame list of upage_entry's process; changed
+  //under frame_lock together with upage_entry
+  struct list_elem owner_elem;
+
   //used for page replacement
   bool used;
   bool has_chance;
-  struct semaphore pin;
+  int64_t last_use;
+
+  //CLOCK-Pro: hot page, counted in hot_cnt
+  bool hot;
+
+  //CLOCK-Pro: cold page still in its test period
+  bool in_test;
+
+  //number of pins held on the frame, one per page_pin_frame or
+  //pinned fault not yet undone; pinned frames are never chosen
+  //for eviction
+  unsigned pin_cnt;
+
+  //held while the frame is being evicted, freed or (un)pinned
+  struct semaphore lock;
+
+  //other pages mapping this frame, and the executable or mapped
+  //file page it holds if other processes may share it
+  struct list sharers;
+  struct hash_elem share_elem;
+  struct inode *inode;
+  size_t offset;
+  size_t read_bytes;
+  bool mmap;
+
+  //written through a mapping that has since been removed
+  bool dirty;
 };
 
-void frame_init (void);
-void *frame_get_page (struct page_entry *, bool pin);
+/* Default free-frame watermarks for the page-out daemon. */
+#define FRAME_LOW_MARK 8
+#define FRAME_HIGH_MARK 32
+
+bool frame_select_policy (const char *name);
+void frame_init (size_t low_mark, size_t high_mark);
+void *frame_get_page (struct page_entry *);
+void *frame_get_free_page (struct page_entry *);
+void *frame_get_free_run (struct page_entry **, size_t cnt);
 void frame_free_page (void *);
-void frame_pin_frame (void *);
+bool frame_pin_frame (void *);
 void frame_unpin_frame (void *);
+void frame_print_stats (void);
+size_t frame_pinned_cnt (uint32_t *pd);
+bool frame_map_shared (struct page_entry *, struct inode *);
+void frame_share (void *, struct inode *);
+bool frame_make_private (void *, struct page_entry *);
+bool frame_copy_unshare (void *, struct page_entry *, void *);
+void frame_sync (void *, struct page_entry *, bool async);
 
 #endif /* vm/frame.h */
@@ -6,6 +6,7 @@
 #include "threads/loader.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
+#include "threads/pte.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/debugf.h"
@@ -13,64 +14,430 @@
 #include "vm/page.h"
 #include "vm/swap.h"
 
+/* Number of pages after a swapped-in page that are read ahead
+   if they sit in the following swap slots. */
+#define SWAP_CLUSTER 4
+
+/* Maximum number of neighbouring file pages mapped along with a
+   faulting file page.  Set with -fa; 0 disables fault-around. */
+size_t page_fault_around = PAGE_FAULT_AROUND;
+
+/* Number of pages mapped by fault-around. */
+static long long fault_around_cnt;
+
+/* Number of shared pages copied on write. */
+static long long cow_cnt;
+
+/* If true, the first fault in a PTSPAN-aligned stretch of
+   anonymous memory that has not been touched yet maps the whole
+   stretch with one 4 MB page.  Set with -lp. */
+bool page_large_pages;
+
+/* Number of large pages mapped. */
+static long long large_cnt;
+
+/* Number of pages in a large page. */
+#define LARGE_PAGE_CNT (PTSPAN / PGSIZE)
+
+/* Maximum size of a process's stack, in pages.  Set with -sl. */
+size_t page_stack_limit = PAGE_STACK_LIMIT;
+
+/* If true, each process prints its statistics when it exits.
+   Set with -stats. */
+bool page_exit_stats;
+
+/* Number of pages the stack area grows by when the stack faults
+   below it, and the number of times it has grown. */
+#define STACK_GROW_CNT 8
+static long long stack_grow_cnt;
+
 static unsigned page_hash (const struct hash_elem *, void *aux UNUSED);
 static bool page_less (const struct hash_elem *, const struct hash_elem *, void *aux UNUSED);
 static struct page_entry *page_lookup (void *, struct hash *);
 static void page_free_entry (struct hash_elem *e, void *aux UNUSED);
+static void page_swap_prefetch (struct supp_page_table *, void *upage, int swap_num);
+static void page_fault_around_file (struct supp_page_table *, struct page_entry *);
+static bool page_read_file (struct page_entry *p, void *kpage);
+static bool page_shareable (struct page_entry *p);
+static bool page_map_writable (struct page_entry *p);
+static bool page_make_private (struct page_entry *p, bool pin);
+static struct page_entry *page_new_entry (void *upage, bool writable, bool stack, bool mmap, bool zero_page, struct file *file, size_t start_offset, size_t read_bytes);
+static struct vm_area *page_find_area (struct supp_page_table *, void *upage);
+static struct page_entry *page_get (struct supp_page_table *, void *upage);
+static bool area_less (const struct list_elem *, const struct list_elem *, void *aux UNUSED);
+static void page_destroy (struct supp_page_table *, struct page_entry *);
+static int page_offset_cmp (const void *, const void *);
+static bool page_range_unused (struct supp_page_table *, void *start, void *end);
+static void page_free_range (struct supp_page_table *, void *start, void *end);
+static bool page_map_large (struct supp_page_table *, struct page_entry *);
+static bool page_grow_stack (struct supp_page_table *, void *upage);
+static struct supp_page_table *page_table_of (struct page_entry *);
 
 void
 page_init (struct thread* t)
 {
   hash_init(&t->page_table.table, page_hash, page_less, NULL);
   sema_init(&t->page_table.lock, 1);
+  list_init(&t->page_table.areas);
+  t->page_table.stack = NULL;
+  memset (&t->page_table.stats, 0, sizeof t->page_table.stats);
+  t->page_table.exiting = false;
+  list_init (&t->page_table.frames);
+
+  /* A new process starts with the limit of the one creating it. */
+  t->page_table.rss_limit = thread_current ()->page_table.rss_limit;
 }
 
+/* Gives the running process a stack area holding the page just
+   below PHYS_BASE.  The area grows down as the stack faults below
+   it; see page_grow_stack. */
 bool
-page_alloc_page (void *uaddr, bool writable, bool stack, bool mmap, bool zero_page, struct file *file, size_t start_offset, size_t read_bytes)
+page_alloc_stack (void)
+{
+  struct supp_page_table *spt = &thread_current ()->page_table;
+  void *upage = (uint8_t *) PHYS_BASE - PGSIZE;
+
+  if (!page_alloc_area (upage, 1, true, false, NULL, 0, 0))
+    return false;
+  spt->stack = page_find_area (spt, upage);
+  spt->stack->stack = true;
+  return true;
+}
+
+/* Returns the lowest address the stack may grow down to. */
+void *
+page_stack_bottom (void)
+{
+  size_t max_cnt = (uintptr_t) PHYS_BASE / PGSIZE - 1;
+  size_t cnt = page_stack_limit < max_cnt ? page_stack_limit : max_cnt;
+
+  return (uint8_t *) PHYS_BASE - cnt * PGSIZE;
+}
+
+/* Moves the start of SPT's stack area down to UPAGE, taking up to
+   STACK_GROW_CNT - 1 more pages below it as well, so that a
+   deepening stack does not fault here again for each page.
+   Returns false if UPAGE is not below the stack, is beyond the
+   stack limit, or is already in use. */
+static bool
+page_grow_stack (struct supp_page_table *spt, void *upage)
+{
+  struct vm_area *a = spt->stack;
+  uint8_t *bottom = page_stack_bottom ();
+  uint8_t *start;
+
+  if (a == NULL || (uint8_t *) upage < bottom || upage >= a->start)
+    return false;
+
+  start = (uint8_t *) upage - (STACK_GROW_CNT - 1) * PGSIZE;
+  if (start < bottom || start > (uint8_t *) upage)
+    start = bottom;
+  if (!page_range_unused (spt, start, a->start))
+    {
+      start = upage;
+      if (!page_range_unused (spt, start, a->start))
+        return false;
+    }
+
+  sema_down (&spt->lock);
+  a->start = start;
+  sema_up (&spt->lock);
+  stack_grow_cnt++;
+  return true;
+}
+
+/* Adds a page entry for UPAGE to the running process's page
+   table and returns it, or returns a null pointer if out of
+   memory. */
+static struct page_entry *
+page_new_entry (void *upage, bool writable, bool stack, bool mmap, bool zero_page, struct file *file, size_t start_offset, size_t read_bytes)
+{
+  struct thread *t = thread_current ();
+  struct supp_page_table *spt = &t->page_table;
+  struct page_entry *p = malloc (sizeof (struct page_entry));
+
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->pagedir = t->pagedir;
+  p->lock_p = &t->page_table.lock;
+
+  p->kpage = NULL;
+  p->shared = false;
+  p->swap_num = -1;
+
+  p->force_swap = false;
+
+  p->writable = writable;
+  //if (p->writable)
+  //  p->force_swap = true;
+
+  p->stack = stack;
+  if (p->stack)
+    p->force_swap = true;
+
+  p->mmap = mmap;
+  p->zero_page = zero_page;
+
+  p->file = file;
+  p->start_offset = start_offset;
+  p->read_bytes = read_bytes;
+
+  sema_down (&spt->lock);
+  hash_insert (&spt->table, &p->elem);
+  sema_up (&spt->lock);
+
+  DEBUGB("[%s] page_new_entry:: Added page entry: upage; %p, writable: %d\n", t->name, upage, writable);
+  return p;
+}
+
+/* Adds an area of PAGE_CNT pages starting at UPAGE to the running
+   process.  The first READ_BYTES bytes are read from FILE starting
+   at OFFSET and the rest are zeroed; MMAP pages are written back
+   to FILE instead of swapped.  With a null FILE the area is
+   anonymous memory, zeroed on first use.  No page entries are
+   created until the pages are faulted in, so this takes the same
+   time for any PAGE_CNT.  Returns false if the area would overlap pages that
+   are already in use. */
+bool
+page_alloc_area (void *upage, size_t page_cnt, bool writable, bool mmap, struct file *file, size_t offset, size_t read_bytes)
+{
+  struct thread *t = thread_current ();
+  struct supp_page_table *spt = &t->page_table;
+  struct vm_area *a;
+  void *end = upage + page_cnt * PGSIZE;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (page_cnt == 0 || !page_range_unused (spt, upage, end))
+    return false;
+
+  a = malloc (sizeof *a);
+  if (a == NULL)
+    return false;
+  a->start = upage;
+  a->end = end;
+  a->file = file;
+  a->offset = offset;
+  a->read_bytes = read_bytes;
+  a->writable = writable;
+  a->mmap = mmap;
+  a->stack = false;
+
+  sema_down (&spt->lock);
+  list_insert_ordered (&spt->areas, &a->elem, area_less, NULL);
+  sema_up (&spt->lock);
+
+  DEBUGB("[%s] page_alloc_area:: %p-%p, read_bytes: %u, writable: %d\n", t->name, upage, end, read_bytes, writable);
+  return true;
+}
+
+/* Grows or shrinks the area starting at UPAGE to PAGE_CNT pages,
+   keeping its start.  Pages cut off the end are freed.  Returns
+   false if PAGE_CNT is 0 or the area cannot grow into pages that
+   are already in use. */
+bool
+page_resize_area (void *upage, size_t page_cnt)
 {
-  void *upage = (void *) pg_round_down (uaddr);
   struct thread *t = thread_current ();
   struct supp_page_table *spt = &t->page_table;
+  struct vm_area *a = page_find_area (spt, upage);
+  void *end = upage + page_cnt * PGSIZE;
 
-  DEBUGA("[%s] page_alloc_page:: Allocating page for upage %p\n", t->name, upage);
+  if (a == NULL || a->start != upage)
+    PANIC ("[%s] No area starts at address %p\n", t->name, upage);
 
-  if (page_lookup (upage, &spt->table) == NULL)
+  if (page_cnt == 0)
+    return false;
+  if (end > a->end)
     {
-      struct page_entry *p = malloc (sizeof (struct page_entry));
+      if (!page_range_unused (spt, a->end, end))
+        return false;
+    }
+  else
+    page_free_range (spt, end, a->end);
 
-      p->upage = upage;
-      p->pagedir = t->pagedir;
-      p->lock_p = &t->page_table.lock;
+  sema_down (&spt->lock);
+  a->end = end;
+  sema_up (&spt->lock);
+  return true;
+}
 
-      p->kpage = NULL;
-      p->swap_num = -1;
+/* Removes the area starting at UPAGE from the running process,
+   freeing the pages of it that were faulted in.  Dirty mmap pages
+   are written back to the file. */
+void
+page_free_area (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct supp_page_table *spt = &t->page_table;
+  struct vm_area *a = page_find_area (spt, upage);
 
-      p->force_swap = false;
+  if (a == NULL || a->start != upage)
+    PANIC ("[%s] No area starts at address %p\n", t->name, upage);
 
-      p->writable = writable;
-      //if (p->writable)
-      //  p->force_swap = true;
+  page_free_range (spt, a->start, a->end);
 
-      p->stack = stack;
-      if (p->stack)
-        p->force_swap = true;
+  sema_down (&spt->lock);
+  list_remove (&a->elem);
+  sema_up (&spt->lock);
+  free (a);
+}
 
-      p->mmap = mmap;
-      p->zero_page = zero_page;
+/* Returns true if no page from START up to END is part of an
+   area or has a page entry in SPT. */
+static bool
+page_range_unused (struct supp_page_table *spt, void *start, void *end)
+{
+  struct list_elem *e;
 
-      p->file = file;
-      p->start_offset = start_offset;
-      p->read_bytes = read_bytes;
+  if (end <= start || !is_user_vaddr (end - 1))
+    return false;
 
-      sema_down (&spt->lock);
-      hash_insert (&spt->table, &p->elem);
-      sema_up (&spt->lock);
+  for (e = list_begin (&spt->areas); e != list_end (&spt->areas); e = list_next (e))
+    {
+      struct vm_area *a = list_entry (e, struct vm_area, elem);
+      if (a->start < end && start < a->end)
+        return false;
+    }
 
-      DEBUGB("[%s] page_alloc_page:: Added page entry: upage; %p, writable: %d\n", t->name, upage, writable);
-      return true;
+  /* The only pages outside areas are stack pages, so check
+     whichever of the range and the page table is smaller. */
+  if ((size_t) (end - start) / PGSIZE <= hash_size (&spt->table))
+    {
+      void *u;
+
+      for (u = start; u < end; u += PGSIZE)
+        if (page_lookup (u, &spt->table) != NULL)
+          return false;
+    }
+  else
+    {
+      struct hash_iterator i;
+
+      hash_first (&i, &spt->table);
+      while (hash_next (&i))
+        {
+          struct page_entry *p = hash_entry (hash_cur (&i), struct page_entry, elem);
+          if (p->upage >= start && p->upage < end)
+            return false;
+        }
+    }
+  return true;
+}
+
+/* Frees the pages from START up to END that were faulted in.
+   Dirty mmap pages are written back to the file. */
+static void
+page_free_range (struct supp_page_table *spt, void *start, void *end)
+{
+  struct page_entry **pages, *p;
+  size_t range_cnt, max_cnt, cnt = 0, i;
+  void *u;
+
+  /* Only pages that were touched have entries.  Gather them by
+     probing the range or by walking the table, whichever is
+     shorter, so that tearing down a large sparse mapping costs
+     nothing for the pages never faulted in. */
+  range_cnt = (end - start) / PGSIZE;
+  max_cnt = hash_size (&spt->table) < range_cnt ? hash_size (&spt->table) : range_cnt;
+  pages = max_cnt > 0 ? malloc (max_cnt * sizeof *pages) : NULL;
+  if (pages == NULL)
+    {
+      for (u = start; u < end; u += PGSIZE)
+        if (page_lookup (u, &spt->table) != NULL)
+          page_free_page (u);
+      return;
+    }
+
+  if (range_cnt <= hash_size (&spt->table))
+    {
+      for (u = start; u < end; u += PGSIZE)
+        if ((p = page_lookup (u, &spt->table)) != NULL)
+          pages[cnt++] = p;
+    }
+  else
+    {
+      struct hash_iterator i;
+
+      hash_first (&i, &spt->table);
+      while (hash_next (&i))
+        {
+          p = hash_entry (hash_cur (&i), struct page_entry, elem);
+          if (p->upage >= start && p->upage < end)
+            pages[cnt++] = p;
+        }
+    }
+
+  /* Dirty pages go back to the file in offset order, which keeps
+     the write-back sequential on disk. */
+  qsort (pages, cnt, sizeof *pages, page_offset_cmp);
+  for (i = 0; i < cnt; i++)
+    page_destroy (spt, pages[i]);
+  free (pages);
+}
+
+/* Orders page entries by their offset in the backing file. */
+static int
+page_offset_cmp (const void *a_, const void *b_)
+{
+  const struct page_entry *a = *(struct page_entry * const *) a_;
+  const struct page_entry *b = *(struct page_entry * const *) b_;
+
+  return a->start_offset < b->start_offset ? -1 : a->start_offset > b->start_offset;
+}
+
+/* Returns the area of SPT containing UPAGE, or a null pointer. */
+static struct vm_area *
+page_find_area (struct supp_page_table *spt, void *upage)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&spt->areas); e != list_end (&spt->areas); e = list_next (e))
+    {
+      struct vm_area *a = list_entry (e, struct vm_area, elem);
+      if (upage < a->start)
+        break;
+      if (upage < a->end)
+        return a;
     }
-  DEBUGB ("%s: Cannot load page to %p, address in use\n", t->name, upage);
-  return false;
+  return NULL;
+}
+
+/* Returns the page entry for UPAGE, creating it if UPAGE lies in
+   one of SPT's areas and has not been touched before.  Returns a
+   null pointer if UPAGE is not mapped at all. */
+static struct page_entry *
+page_get (struct supp_page_table *spt, void *upage)
+{
+  struct page_entry *p = page_lookup (upage, &spt->table);
+  struct vm_area *a;
+  size_t ofs, read_bytes;
+
+  if (p != NULL)
+    return p;
+  a = page_find_area (spt, upage);
+  if (a == NULL)
+    return NULL;
+
+  ofs = upage - a->start;
+  read_bytes = 0;
+  if (a->read_bytes > ofs)
+    read_bytes = a->read_bytes - ofs < PGSIZE ? a->read_bytes - ofs : PGSIZE;
+
+  return page_new_entry (upage, a->writable, a->stack, a->mmap, read_bytes == 0,
+                         a->file, a->offset + ofs, read_bytes);
+}
+
+/* Returns true if area A starts before area B. */
+static bool
+area_less (const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct vm_area *a = list_entry (a_, struct vm_area, elem);
+  const struct vm_area *b = list_entry (b_, struct vm_area, elem);
+
+  return a->start < b->start;
 }
 
 void
@@ -84,21 +451,27 @@ page_free_page (void *uaddr)
 
   if (p != NULL)
     {
+      page_destroy (spt, p);
+      return;
+    }
+  PANIC ("[%s] No page allocated for address %p\n", t->name, upage);
+}
 
-      if (p->kpage != NULL)
-        frame_free_page (p->kpage);
+/* Releases P's frame or swap slot and removes it from SPT. */
+static void
+page_destroy (struct supp_page_table *spt, struct page_entry *p)
+{
+  if (p->kpage != NULL)
+    frame_free_page (p->kpage);
 
-      if (p->swap_num > -1)
-        swap_free_page (p->swap_num);
+  if (p->swap_num > -1)
+    swap_free_page (p->swap_num);
 
-      sema_down (&spt->lock);
-      hash_delete (&spt->table, &p->elem);
-      sema_up (&spt->lock);
+  sema_down (&spt->lock);
+  hash_delete (&spt->table, &p->elem);
+  sema_up (&spt->lock);
 
-      free (p);
-      return;
-    }
-  PANIC ("[%s] No page allocated for address %p\n", t->name, upage);
+  free (p);
 }
 
 bool
@@ -107,17 +480,20 @@ page_fix_page (void *uaddr, bool stack, bool write, bool pin)
   void *upage = (void *) pg_round_down (uaddr);
   struct thread *t = thread_current ();
   struct supp_page_table *spt = &t->page_table;
-  struct page_entry *p = page_lookup (upage, &spt->table);
+  struct page_entry *p = page_get (spt, upage);
+  int swapped_in = -1;
+  bool file_read = false;
 
   if (p == NULL)
     {
-      if (write && stack)
+      /* Below the stack: grow the stack area and make the entry
+         directly, since page_get has just missed. */
+      if (write && stack && page_grow_stack (spt, upage))
         {
           DEBUGB("[%s] page_fix_page:: stack access, allocating page\n", t->name);
-          page_alloc_page (upage, true, true, false, false, NULL, 0, 0);
-          p = page_lookup (upage, &spt->table);
+          p = page_new_entry (upage, true, true, false, true, NULL, 0, 0);
         }
-      else
+      if (p == NULL)
         {
           DEBUGA("[%s] page_fix_page:: bad pointer\n", t->name);
           return false;
@@ -128,79 +504,455 @@ page_fix_page (void *uaddr, bool stack, bool write, bool pin)
   if (write && !p->writable)
     return false;
 
+retry:
+  /* Already there, or on its way out; in the latter case the
+     access faults again once eviction has finished. */
+  if (p->kpage != NULL)
+    {
+      spt->stats.minor_faults++;
+      goto resident;
+    }
+
+  if (page_large_pages && p->file == NULL && !p->stack
+      && p->swap_num == -1 && page_map_large (spt, p))
+    {
+      spt->stats.minor_faults++;
+      goto resident;
+    }
+
+  /* Read-only executable pages, and data pages until they are
+     written, are shared with other processes running the same
+     executable.  Mapped file pages are shared with every process
+     mapping the same file, writes included. */
+  bool share = (p->mmap || !write) && page_shareable (p);
+  if (share && frame_map_shared (p, file_get_inode (p->file)))
+    {
+      DEBUGB("[%s] page_fix_page:: mapped shared frame %p\n", t->name, p->kpage);
+      spt->stats.minor_faults++;
+      goto resident;
+    }
+
   DEBUGC("[%s] page_fix_page:: getting a frame\n", t->name);
-  p->kpage = frame_get_page (p, pin);
+  void *kpage = frame_get_page (p);
+  if (kpage == NULL)
+    return false;
 
+  /* The frame comes back pinned.  Take our page table lock before
+     touching P, in case another process is still evicting it. */
   sema_down (&spt->lock);
+  p->kpage = kpage;
+  spt->stats.resident++;
   if (p->swap_num > -1)
     {
       DEBUGB("[%s] page_fix_page:: load page from swap %d to kpage: %p; upage %p\n", t->name, p->swap_num, p->kpage, p->upage);
       swap_load_page (p->kpage, p->swap_num);
+      swapped_in = p->swap_num;
       p->swap_num = -1;
+      spt->stats.major_faults++;
+      spt->stats.swap_ins++;
     }
   else if (!p->stack && !p->zero_page) // not in swap, not a new stack page, not a zero page, has to be file
     {
       DEBUGB("[%s] page_fix_page:: reading %u bytes from file %p\n", t->name, p->read_bytes, p->file);
-      if (file_read_at(p->file, p->kpage, p->read_bytes, p->start_offset) < p->read_bytes)
-      {
-        file_reopen(p->file);
-        file_read_at(p->file, p->kpage, p->read_bytes, p->start_offset);
-      }
-
-      size_t zero_bytes = PGSIZE - p->read_bytes;
-      if (zero_bytes > 0)
-        {
-          memset (p->kpage + p->read_bytes, 0, zero_bytes);
-        }
+      page_read_file (p, p->kpage);
+      file_read = true;
+      p->shared = share;
+      spt->stats.major_faults++;
     }
   else //if (p->stack || p->zero_page) //if it's stack and not in swap, give a new page OR if it's supposed to be 0, zero out
     {
       DEBUGB("[%s] page_fix_page:: writing zeros to kpage; p->stack: %d; p->zero_page: %d\n", t->name, p->stack, p->zero_page);
       memset(p->kpage, 0, PGSIZE);
+      spt->stats.minor_faults++;
     }
   DEBUGB("[%s] page_fix_page:: adding entry to pagedir: upage: %p, kpage: %p, %s: pagedir: %p\n", t->name, p->upage, p->kpage, t->name, p->pagedir);
-  pagedir_set_page (p->pagedir, p->upage, p->kpage, p->writable);
+  pagedir_set_page (p->pagedir, p->upage, p->kpage, page_map_writable (p));
+  sema_up (&spt->lock);
+
+  if (p->shared)
+    frame_share (kpage, file_get_inode (p->file));
+  if (!pin)
+    frame_unpin_frame (kpage);
+
+  if (swapped_in > -1)
+    page_swap_prefetch (spt, p->upage, swapped_in);
+  else if (file_read)
+    page_fault_around_file (spt, p);
+
+  return true;
+
+resident:
+  /* P was in memory without a new frame.  If it must be pinned
+     but the frame is being evicted, frame_pin_frame fails once
+     the evictor is done with it; fault the page back in then. */
+  {
+    void *kpage = p->kpage;
+
+    if (!pin || (kpage != NULL && frame_pin_frame (kpage)))
+      return true;
+
+    /* The evictor clears P's kpage under our page table lock. */
+    sema_down (&spt->lock);
+    sema_up (&spt->lock);
+    if (kpage != NULL && p->kpage == kpage)
+      return false;
+    goto retry;
+  }
+}
+
+/* Reads ahead the pages following UPAGE that were swapped out to
+   the slots following SWAP_NUM, as long as free frames are
+   available.  swap_dump_page tries to keep neighbouring pages in
+   neighbouring slots, so a sequential sweep over swapped-out
+   memory turns into sequential reads. */
+static void
+page_swap_prefetch (struct supp_page_table *spt, void *upage, int swap_num)
+{
+  int i;
+
+  for (i = 1; i <= SWAP_CLUSTER; i++)
+    {
+      void *next = upage + i * PGSIZE;
+      struct page_entry *p;
+      void *kpage;
+
+      if (!is_user_vaddr (next))
+        break;
+      p = page_lookup (next, &spt->table);
+      if (p == NULL || p->kpage != NULL || p->swap_num != swap_num + i)
+        break;
+
+      kpage = frame_get_free_page (p);
+      if (kpage == NULL)
+        break;
+
+      sema_down (&spt->lock);
+      DEBUGB("page_swap_prefetch:: reading ahead swap %d to upage %p\n", p->swap_num, p->upage);
+      p->kpage = kpage;
+      swap_load_page (kpage, p->swap_num);
+      p->swap_num = -1;
+      spt->stats.resident++;
+      spt->stats.swap_ins++;
+      pagedir_set_page (p->pagedir, p->upage, kpage, p->writable);
+      sema_up (&spt->lock);
+      frame_unpin_frame (kpage);
+    }
+}
+
+/* Gives the running process a private, writable copy of the
+   shared page at UADDR, after a write to it faulted.  Leaves the
+   new frame pinned if PIN is true.  Returns false if UADDR is not
+   a shared copy-on-write page. */
+bool
+page_break_cow (void *uaddr, bool pin)
+{
+  void *upage = (void *) pg_round_down (uaddr);
+  struct thread *t = thread_current ();
+  struct supp_page_table *spt = &t->page_table;
+  struct page_entry *p = page_lookup (upage, &spt->table);
+
+  if (p == NULL || !p->shared || p->mmap || !p->writable || p->kpage == NULL)
+    return false;
+  if (!page_make_private (p, pin))
+    return false;
+  spt->stats.minor_faults++;
+  cow_cnt++;
+  return true;
+}
+
+/* Moves P, which is mapped to a shared frame, to a frame of its
+   own that it may write to and that is swapped rather than
+   written back to the file.  Leaves the frame pinned if PIN is
+   true.  Returns false if out of memory. */
+static bool
+page_make_private (struct page_entry *p, bool pin)
+{
+  struct supp_page_table *spt = &thread_current ()->page_table;
+  void *old_kpage = p->kpage;
+  void *kpage;
+
+  if (frame_make_private (old_kpage, p))
+    kpage = old_kpage;
+  else
+    {
+      kpage = frame_get_page (p);
+      if (kpage == NULL)
+        return false;
+      /* If the shared frame was evicted meanwhile, reread the page;
+         if it was evicted to make room for this copy, its contents
+         are still intact. */
+      if (kpage != old_kpage && !frame_copy_unshare (old_kpage, p, kpage))
+        page_read_file (p, kpage);
+    }
+
+  DEBUGB("page_make_private:: copied upage %p to kpage %p\n", p->upage, kpage);
+  sema_down (&spt->lock);
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (p->kpage == NULL)
+    spt->stats.resident++;
+  p->kpage = kpage;
+  p->shared = false;
+  p->force_swap = true;
+  pagedir_set_page (p->pagedir, p->upage, kpage, p->writable);
   sema_up (&spt->lock);
 
+  if (!pin)
+    frame_unpin_frame (kpage);
   return true;
 }
 
+/* Returns true if P is a not yet modified page of an executable
+   or a page of a mapped file, which other processes may share. */
+static bool
+page_shareable (struct page_entry *p)
+{
+  return (p->file != NULL && p->kpage == NULL && p->swap_num == -1
+          && !p->stack && !p->zero_page && !p->force_swap);
+}
+
+/* Returns true if P's frame may be mapped writable.  Shared
+   executable pages are copied on the first write instead. */
+static bool
+page_map_writable (struct page_entry *p)
+{
+  return p->writable && (!p->shared || p->mmap);
+}
+
+/* Reads P's file data into KPAGE and zeroes the rest of the
+   page.  Returns true if all of the data could be read. */
+static bool
+page_read_file (struct page_entry *p, void *kpage)
+{
+  off_t bytes = file_read_at (p->file, kpage, p->read_bytes, p->start_offset);
+
+  memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  return bytes == (off_t) p->read_bytes;
+}
+
+/* Returns true if N is a page of the same file mapping as P,
+   DELTA pages away, that has never been loaded or modified. */
+static bool
+page_fault_around_ok (struct page_entry *p, struct page_entry *n, int delta)
+{
+  return (n != NULL && n->kpage == NULL && n->swap_num == -1
+          && !n->stack && !n->zero_page && !n->force_swap
+          && n->mmap == p->mmap && n->file == p->file
+          && n->writable == p->writable
+          && (off_t) n->start_offset
+             == (off_t) p->start_offset + delta * PGSIZE);
+}
+
+/* Maps up to page_fault_around not-yet-loaded pages of P's file
+   mapping next to P, which was just read from its file, first
+   following P and then preceding it.  Only free frames are used,
+   so fault-around never forces an eviction, and the pages start
+   without a second chance so unused ones are reclaimed first. */
+static void
+page_fault_around_file (struct supp_page_table *spt, struct page_entry *p)
+{
+  size_t done = 0;
+  int dir;
+
+  for (dir = 1; dir >= -1; dir -= 2)
+    {
+      int i;
+
+      for (i = 1; done < page_fault_around; i++)
+        {
+          void *next = p->upage + dir * i * PGSIZE;
+          struct page_entry *n;
+          void *kpage;
+
+          if (!is_user_vaddr (next) || (dir < 0 && next > p->upage))
+            break;
+          n = page_get (spt, next);
+          if (!page_fault_around_ok (p, n, dir * i))
+            break;
+
+          /* N is shareable, like P. */
+          if (!frame_map_shared (n, file_get_inode (n->file)))
+            {
+              kpage = frame_get_free_page (n);
+              if (kpage == NULL)
+                return;
+
+              sema_down (&spt->lock);
+              DEBUGB("page_fault_around_file:: mapping upage %p\n", n->upage);
+              n->kpage = kpage;
+              n->shared = true;
+              spt->stats.resident++;
+              page_read_file (n, kpage);
+              pagedir_set_page (n->pagedir, n->upage, kpage, page_map_writable (n));
+              sema_up (&spt->lock);
+              frame_share (kpage, file_get_inode (n->file));
+              frame_unpin_frame (kpage);
+            }
+
+          fault_around_cnt++;
+          done++;
+        }
+    }
+}
+
+/* Prints fault-around statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Page: %lld pages mapped by fault-around, %lld shared pages copied on write\n",
+          fault_around_cnt, cow_cnt);
+  printf ("Page: stack grown %lld times\n", stack_grow_cnt);
+  if (page_large_pages)
+    printf ("Page: %lld large pages mapped\n", large_cnt);
+}
+
+/* Maps the PTSPAN-aligned stretch of anonymous memory containing
+   P, which is being faulted in for the first time, with a single
+   large page.  This is only done if P's area covers the whole
+   stretch, no page of it has been mapped before, and a free,
+   suitably aligned run of frames exists; nothing is evicted to
+   make one.  The stretch is split back into ordinary pages as
+   soon as one of them is evicted or freed.  Returns true if P is
+   now mapped. */
+static bool
+page_map_large (struct supp_page_table *spt, struct page_entry *p)
+{
+  uint8_t *base = (uint8_t *) ((uintptr_t) p->upage & ~(uintptr_t) (PTSPAN - 1));
+  struct vm_area *a = page_find_area (spt, p->upage);
+  struct page_entry **pages;
+  size_t i, cnt;
+  uint8_t *kpage = NULL;
+
+  if (a == NULL || (uint8_t *) a->start > base || (uint8_t *) a->end < base + PTSPAN
+      || !pagedir_is_span_unused (p->pagedir, base))
+    return false;
+
+  pages = malloc (LARGE_PAGE_CNT * sizeof *pages);
+  if (pages == NULL)
+    return false;
+
+  /* Untouched pages have no entries yet, except P itself. */
+  for (cnt = 0; cnt < LARGE_PAGE_CNT; cnt++)
+    {
+      void *upage = base + cnt * PGSIZE;
+
+      if (upage == p->upage)
+        pages[cnt] = p;
+      else if (page_lookup (upage, &spt->table) != NULL)
+        break;
+      else if ((pages[cnt] = page_new_entry (upage, a->writable, false, false, true,
+                                             NULL, 0, 0)) == NULL)
+        break;
+    }
+  if (cnt == LARGE_PAGE_CNT)
+    kpage = frame_get_free_run (pages, LARGE_PAGE_CNT);
+
+  if (kpage == NULL)
+    {
+      for (i = 0; i < cnt; i++)
+        if (pages[i] != p)
+          page_destroy (spt, pages[i]);
+      free (pages);
+      return false;
+    }
+
+  memset (kpage, 0, PTSPAN);
+  sema_down (&spt->lock);
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    pages[i]->kpage = kpage + i * PGSIZE;
+  spt->stats.resident += LARGE_PAGE_CNT;
+  if (!pagedir_set_large_page (p->pagedir, base, kpage, a->writable))
+    NOT_REACHED ();
+  sema_up (&spt->lock);
+
+  for (i = 0; i < LARGE_PAGE_CNT; i++)
+    frame_unpin_frame (pages[i]->kpage);
+  free (pages);
+
+  large_cnt++;
+  DEBUGB("[%s] page_map_large:: mapped %p-%p to kpage %p\n", thread_current ()->name, base, base + PTSPAN, kpage);
+  return true;
+}
+
+/* Returns a good swap slot for P, which is about to be swapped
+   out: the slot right after its predecessor's or right before
+   its successor's, if either neighbour is in swap, otherwise -1.
+   Also -1 if P's process is exiting, whose table is being freed.
+   The caller must hold P's page table lock. */
+int
+page_swap_hint (struct page_entry *p)
+{
+  struct supp_page_table *spt = page_table_of (p);
+  struct page_entry *n;
+
+  if (spt->exiting)
+    return -1;
+  n = page_lookup (p->upage - PGSIZE, &spt->table);
+  if (n != NULL && n->swap_num > -1)
+    return n->swap_num + 1;
+  n = page_lookup (p->upage + PGSIZE, &spt->table);
+  if (n != NULL && n->swap_num > 0)
+    return n->swap_num - 1;
+  return -1;
+}
+
+/* Frees the running process's pages, frames and swap slots. */
 void
 page_free_all (void)
 {
   struct thread *t = thread_current();
   struct supp_page_table *spt = &t->page_table;
+  struct hash_iterator i;
 
+  /* Give back the frames first, without the page table lock:
+     frame_free_page takes a frame's lock before it, as evictors
+     do, and so also waits out any eviction of the page. */
+  hash_first (&i, &spt->table);
+  while (hash_next (&i))
+    {
+      struct page_entry *p = hash_entry (hash_cur (&i), struct page_entry, elem);
+      if (p->kpage != NULL)
+        frame_free_page (p->kpage);
+    }
+
+  /* Evictors of other processes' pages may still read the table
+     for swap hints until EXITING is set. */
+  sema_down (&spt->lock);
+  spt->exiting = true;
   hash_destroy (&spt->table, page_free_entry);
+  while (!list_empty (&spt->areas))
+    free (list_entry (list_pop_front (&spt->areas), struct vm_area, elem));
+  sema_up (&spt->lock);
 }
 
+/* Frees page entry E and its swap slot.  Its frame was already
+   released by page_free_all.  The caller must hold the page
+   table lock. */
 static void
 page_free_entry (struct hash_elem *e, void *aux UNUSED)
 {
   struct page_entry *p = hash_entry(e, struct page_entry, elem);
 
-  if (p->kpage != NULL)
-    frame_free_page (p->kpage);
-
   if (p->swap_num > -1)
     swap_free_page (p->swap_num);
 
   free(p);
 }
 
-bool
-page_unmap (void* upage)
+/* Writes UPAGE, a page of a mapped file, back to the file if it
+   is in memory and was written to since it was last written back.
+   If ASYNC is true, the write is left to a kernel thread. */
+void
+page_sync (void *upage, bool async)
 {
-  struct thread *t = thread_current ();
-  struct supp_page_table *spt = &t->page_table;
+  struct supp_page_table *spt = &thread_current ()->page_table;
   struct page_entry *p = page_lookup (upage, &spt->table);
+  void *kpage;
 
-  if (p != NULL)
-    {
-      p->mmap = false;
-      return true;
-    }
-  return false;
+  if (p == NULL || !p->mmap || !p->writable)
+    return;
+  kpage = p->kpage;
+  if (kpage != NULL)
+    frame_sync (kpage, p, async);
 }
 
 /* Returns a hash value for page p. */
@@ -247,6 +999,9 @@ page_pin_frame (void* upage)
 }
 */
 
+/* Brings the page at UADDR into memory, if needed, and pins it
+   there.  Returns false if the page is invalid, read-only and
+   WRITE is true, or could not be brought in. */
 bool
 page_pin_frame (void *uaddr, bool write)
 {
@@ -256,13 +1011,11 @@ page_pin_frame (void *uaddr, bool write)
   DEBUGB("[%s] page_pin_frame:: pinning page %p\n", t->name, upage);
   struct page_entry *p = page_lookup (upage, &spt->table);
   DEBUGB("[%s] page_pin_frame:: p: %p; p->kpage: %p\n", t->name, p, p->kpage);
-  if (p != NULL && p->kpage != NULL)
-    {
-      frame_pin_frame (p->kpage);
-      return true;
-    }
-  page_fix_page(upage, ((upage > t->last_stack) ? true: false), write, true);
-  return false;
+  if (write && page_break_cow (upage, true))
+    return true;
+  if (p != NULL && p->kpage != NULL && frame_pin_frame (p->kpage))
+    return true;
+  return page_fix_page (upage, upage > t->last_stack, write, true);
 }
 
 void
@@ -279,3 +1032,50 @@ page_unpin_frame (void *uaddr)
   frame_unpin_frame (p->kpage);
 }
 
+/* Returns the page table that P belongs to. */
+static struct supp_page_table *
+page_table_of (struct page_entry *p)
+{
+  return (struct supp_page_table *)
+    ((uint8_t *) p->lock_p - offsetof (struct supp_page_table, lock));
+}
+
+/* Returns the statistics of the process that P belongs to.
+   Changing the resident count requires P's page table lock. */
+struct vm_stats *
+page_stats (struct page_entry *p)
+{
+  return &page_table_of (p)->stats;
+}
+
+/* Returns the list of resident frames of the process that P
+   belongs to.  See frame_set_owner. */
+struct list *
+page_frames (struct page_entry *p)
+{
+  return &page_table_of (p)->frames;
+}
+
+/* Returns true if the process that P belongs to has a resident
+   set limit that CNT more resident pages would exceed. */
+bool
+page_rss_full (struct page_entry *p, size_t cnt)
+{
+  struct supp_page_table *spt = page_table_of (p);
+
+  return spt->rss_limit != 0 && spt->stats.resident + cnt > spt->rss_limit;
+}
+
+/* Prints the running process's statistics. */
+void
+page_print_process_stats (void)
+{
+  struct thread *t = thread_current ();
+  struct vm_stats *st = &t->page_table.stats;
+
+  printf ("%s: vm: %u minor faults, %u major faults, %u swapped in, "
+          "%u swapped out, %u written back, %u resident, %u pinned\n",
+          t->name, st->minor_faults, st->major_faults, st->swap_ins,
+          st->swap_outs, st->writebacks, st->resident,
+          frame_pinned_cnt (t->pagedir));
+}
@@ -2,12 +2,76 @@
 #define VM_PAGE_H
 
 #include <hash.h>
+#include <list.h>
 #include "threads/synch.h"
 
+/* Default number of neighbouring file pages mapped on a fault. */
+#define PAGE_FAULT_AROUND 4
+
+/* Smallest resident set limit, enough for an instruction and
+   the pages it touches. */
+#define PAGE_RSS_MIN 16
+
+/* Default maximum stack size, in pages. */
+#define PAGE_STACK_LIMIT 2048
+
+extern size_t page_fault_around;
+extern bool page_large_pages;
+extern size_t page_stack_limit;
+extern bool page_exit_stats;
+
+/* Virtual memory statistics of one process. */
+struct vm_stats
+{
+  unsigned minor_faults;        /* Faults served without I/O. */
+  unsigned major_faults;        /* Faults that read a file or swap. */
+  unsigned swap_ins;            /* Pages read back from swap. */
+  unsigned swap_outs;           /* Pages written to swap. */
+  unsigned writebacks;          /* Dirty mmap pages written to files. */
+  unsigned resident;            /* Pages in memory now. */
+};
+
 struct supp_page_table
 {
   struct hash table;
   struct semaphore lock;
+
+  // struct vm_area, sorted by start
+  struct list areas;
+
+  // the stack, one of areas; grows down
+  struct vm_area *stack;
+
+  // resident is changed under lock, by evictors too
+  struct vm_stats stats;
+
+  // if nonzero, at most this many pages stay resident; beyond it
+  // the process replaces its own pages
+  size_t rss_limit;
+
+  // frames whose upage_entry is one of our pages, in clock order;
+  // protected by frame_lock
+  struct list frames;
+
+  // set under lock when the owner starts tearing the table down;
+  // evictors must not look at table after that
+  bool exiting;
+};
+
+/* A contiguous range of pages backed the same way, such as an
+   ELF segment or a mapped file.  Page entries for it are created
+   only when a page is first faulted in. */
+struct vm_area
+{
+  struct list_elem elem;
+  void *start;                // first page
+  void *end;                  // one past the last page
+  struct file *file;
+  size_t offset;              // file offset of start
+  size_t read_bytes;          // file bytes from start; the rest is zeroed
+  bool writable;
+  bool mmap;
+  bool stack;
 };
 
 struct page_entry
@@ -20,6 +84,11 @@ struct page_entry
   // if loaded into frame
   void *kpage;
 
+  // if kpage may be mapped by other processes too; such pages are
+  // mapped read-only and copied on the first write
+  bool shared;
+  struct list_elem share_elem;
+
   // if swapped out
   int swap_num;
 
@@ -37,12 +106,23 @@ struct page_entry
 };
 
 void page_init (struct thread *t);
-bool page_alloc_page (void *uaddr, bool writable, bool stack, bool mmap, bool zero_page, struct file *file, size_t start_offset, size_t read_bytes);
+bool page_alloc_stack (void);
+void *page_stack_bottom (void);
 void page_free_page (void *uaddr);
+bool page_alloc_area (void *upage, size_t page_cnt, bool writable, bool mmap, struct file *file, size_t offset, size_t read_bytes);
+bool page_resize_area (void *upage, size_t page_cnt);
+void page_free_area (void *upage);
 bool page_fix_page (void *uaddr, bool stack, bool write, bool pin);
 void page_free_all(void);
-bool page_unmap (void* upage);
+void page_sync (void *upage, bool async);
+bool page_break_cow (void *uaddr, bool pin);
 bool page_pin_frame (void* upage, bool write);
 void page_unpin_frame (void* upage);
+int page_swap_hint (struct page_entry *);
+void page_print_stats (void);
+struct vm_stats *page_stats (struct page_entry *);
+struct list *page_frames (struct page_entry *);
+bool page_rss_full (struct page_entry *, size_t cnt);
+void page_print_process_stats (void);
 
 #endif /* vm/page.h */
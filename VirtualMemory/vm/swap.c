@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <bitmap.h>
 #include "devices/block.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
@@ -9,65 +11,119 @@
 
 #define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* In-memory compressed tier in front of the swap device.  Pages
+   that compress to ZSWAP_MAX_SIZE bytes or less are kept in
+   malloc'd buffers, up to ZSWAP_SLOTS pages and ZSWAP_MAX_BYTES
+   in total.  Their slot numbers follow the disk slots. */
+#define ZSWAP_SLOTS 512
+#define ZSWAP_MAX_SIZE (PGSIZE / 4)
+#define ZSWAP_MAX_BYTES (128 * 1024)
+
 static struct block *swap_device;
 static size_t num_slots;
-static bool *free_map;
+
+/* One bit per slot, set while the slot holds a page.  Slots are
+   handed out next-fit starting at next_slot, so consecutive
+   evictions do not rescan the slots in use at the front. */
+static struct bitmap *used_map;
+static size_t next_slot;
+
+/* Compressed tier: one bit per slot in zused_map, and the
+   compressed bytes of each slot in zslots. */
+struct zslot
+  {
+    uint8_t *data;
+    size_t size;
+  };
+static struct bitmap *zused_map;
+static struct zslot zslots[ZSWAP_SLOTS];
+static size_t zswap_bytes;
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+
+/* Statistics. */
+static long long zero_cnt;        /* All-zero pages, nothing stored. */
+static long long compressed_cnt;  /* Pages kept compressed in memory. */
+static long long disk_cnt;        /* Pages written to the device. */
 
 static size_t total_blocks;
 struct semaphore swap_lock;
 
+static bool page_is_zero (const void *kpage);
+static size_t compress_page (const uint8_t *kpage, uint8_t *out, size_t max);
+static void decompress_page (const uint8_t *in, size_t size, uint8_t *kpage);
+static int zswap_store (const void *kpage);
+
 void
 swap_init (void)
 {
-  unsigned i;
-
   sema_init(&swap_lock, 1);
 
   swap_device = block_get_role (BLOCK_SWAP);
-  total_blocks = block_size (swap_device);
+  total_blocks = swap_device != NULL ? block_size (swap_device) : 0;
   num_slots = total_blocks / PAGE_SECTORS;
-  free_map = malloc (sizeof (bool) * num_slots);
-
-  for (i = 0; i < num_slots; i++) {
-    free_map[i] = false;
-  }
+  used_map = bitmap_create (num_slots);
+  zused_map = bitmap_create (ZSWAP_SLOTS);
+  if (used_map == NULL || zused_map == NULL)
+    PANIC ("swap_init:: cannot allocate swap map");
+  next_slot = 0;
+  zswap_bytes = 0;
 
   DEBUGB ("swap_init:: total_blocks: %d; page_sector_size: %d; num_slots: %d\n",
 	  total_blocks, PAGE_SECTORS, num_slots);
 }
 
+/* Saves the page at KPAGE and returns the slot number it can be
+   loaded back from, SWAP_ZERO if the page is all zeros and
+   nothing was stored, or SWAP_ERROR if swap is full.  Pages that
+   compress well are kept in memory; the rest go to the swap
+   device.  Disk slot HINT is used if it is free, so that pages
+   adjacent in virtual memory can be kept adjacent on disk and
+   read back together; pass -1 for no preference. */
 int
-swap_dump_page (void *kpage)
+swap_dump_page (void *kpage, int hint)
 {
-  unsigned i;
+  size_t swap_num = BITMAP_ERROR;
+  int zslot;
 
-  int swap_num = 0;
+  if (page_is_zero (kpage))
+    {
+      zero_cnt++;
+      return SWAP_ZERO;
+    }
 
   sema_down(&swap_lock);
-  while (free_map[swap_num]) {
-    swap_num++;
-  }
-  free_map[swap_num] = true;
-  sema_up(&swap_lock);
+  zslot = zswap_store (kpage);
+  if (zslot >= 0)
+    {
+      sema_up(&swap_lock);
+      compressed_cnt++;
+      return num_slots + zslot;
+    }
+
+  if (hint >= 0 && (size_t) hint < num_slots && !bitmap_test (used_map, hint))
+    {
+      bitmap_mark (used_map, hint);
+      swap_num = hint;
+    }
+  if (swap_num == BITMAP_ERROR)
+    swap_num = bitmap_scan_and_flip (used_map, next_slot, 1, false);
+  if (swap_num == BITMAP_ERROR && next_slot > 0)
+    swap_num = bitmap_scan_and_flip (used_map, 0, 1, false);
+  if (swap_num == BITMAP_ERROR)
+    {
+      sema_up(&swap_lock);
+      DEBUGB ("swap_dump_page:: swap is full (%d slots)\n", num_slots);
+      return SWAP_ERROR;
+    }
+  next_slot = swap_num + 1 < num_slots ? swap_num + 1 : 0;
 
   block_sector_t sector = swap_num * PAGE_SECTORS;
 
   DEBUGB ("swap_dump_page:: dumping %p to swap_num: %d; starting sector: %d\n",
       kpage, swap_num, sector);
 
-  if (sector + PAGE_SECTORS >= total_blocks)
-    {
-      DEBUGB ("swap_dump_page:: ERROR: last sector %d out of range (greater than %d)",
-          sector + PAGE_SECTORS, total_blocks);
-      return -1;
-    }
-
-  sema_down(&swap_lock);
-  for (i = 0; i < PAGE_SECTORS; i++) {
-    DEBUGB ("swap_dump_page:: writing data at address %p to sector %d\n", kpage + (i * BLOCK_SECTOR_SIZE), sector + i);
-    //hex_dump (kpage + (i * BLOCK_SECTOR_SIZE), kpage + (i * BLOCK_SECTOR_SIZE), BLOCK_SECTOR_SIZE, true);
-    block_write (swap_device, sector + i, kpage + (i * BLOCK_SECTOR_SIZE));
-  }
+  block_write_multiple (swap_device, sector, PAGE_SECTORS, kpage);
+  disk_cnt++;
 
   sema_up(&swap_lock);
 
@@ -77,29 +133,27 @@ swap_dump_page (void *kpage)
 void
 swap_load_page (void *kpage, int swap_num)
 {
-  unsigned i;
+  ASSERT (swap_num >= 0 && (size_t) swap_num < num_slots + ZSWAP_SLOTS);
 
-  block_sector_t sector = swap_num * PAGE_SECTORS;
-  DEBUGB ("swap_load_page:: loading to %p from swap_num: %d; starting sector: %d\n", kpage, swap_num, sector);
-
-  if (sector + PAGE_SECTORS >= total_blocks)
+  if ((size_t) swap_num >= num_slots)
     {
-      DEBUGB ("swap_load_page:: ERROR: last sector %d out of range (greater than %d)",
-          sector + PAGE_SECTORS, total_blocks);
+      struct zslot *z = &zslots[swap_num - num_slots];
+
+      DEBUGB ("swap_load_page:: decompressing slot %d to %p\n", swap_num, kpage);
+      sema_down (&swap_lock);
+      decompress_page (z->data, z->size, kpage);
+      sema_up (&swap_lock);
+      swap_free_page (swap_num);
       return;
     }
 
+  block_sector_t sector = swap_num * PAGE_SECTORS;
+  DEBUGB ("swap_load_page:: loading to %p from swap_num: %d; starting sector: %d\n", kpage, swap_num, sector);
+
   sema_down (&swap_lock);
-  for (i = 0; i < PAGE_SECTORS; i++)
-    {
-      block_read (swap_device, sector + i, kpage + (i * BLOCK_SECTOR_SIZE));
-      DEBUGB ("swap_load_page:: writing data at address %p to sector %d\n", kpage + (i * BLOCK_SECTOR_SIZE), sector + i);
-      //hex_dump (kpage + (i * BLOCK_SECTOR_SIZE), kpage + (i * BLOCK_SECTOR_SIZE), BLOCK_SECTOR_SIZE, true);
-    }
-  //sema_up (&swap_lock);
+  block_read_multiple (swap_device, sector, PAGE_SECTORS, kpage);
 
-  //sema_down(&swap_lock);
-  free_map[swap_num] = false;
+  bitmap_reset (used_map, swap_num);
   sema_up(&swap_lock);
 }
 
@@ -107,8 +161,106 @@ swap_load_page (void *kpage, int swap_num)
 void
 swap_free_page (int swap_num)
 {
+  ASSERT (swap_num >= 0 && (size_t) swap_num < num_slots + ZSWAP_SLOTS);
+
   sema_down(&swap_lock);
-  free_map[swap_num] = false;
+  if ((size_t) swap_num >= num_slots)
+    {
+      struct zslot *z = &zslots[swap_num - num_slots];
+
+      zswap_bytes -= z->size;
+      free (z->data);
+      z->data = NULL;
+      bitmap_reset (zused_map, swap_num - num_slots);
+    }
+  else
+    bitmap_reset (used_map, swap_num);
   sema_up(&swap_lock);
 }
 
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld zero pages, %lld compressed, %lld written to disk\n",
+          zero_cnt, compressed_cnt, disk_cnt);
+}
+
+/* Returns true if every byte of the page at KPAGE is zero. */
+static bool
+page_is_zero (const void *kpage)
+{
+  const uint32_t *p = kpage;
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *p; i++)
+    if (p[i] != 0)
+      return false;
+  return true;
+}
+
+/* Tries to keep a compressed copy of the page at KPAGE in
+   memory.  Returns its compressed-tier slot, or -1 if the page
+   does not compress well enough or the tier is full.  The caller
+   must hold swap_lock. */
+static int
+zswap_store (const void *kpage)
+{
+  size_t size, slot;
+
+  size = compress_page (kpage, zbuf, sizeof zbuf);
+  if (size == 0 || zswap_bytes + size > ZSWAP_MAX_BYTES)
+    return -1;
+
+  slot = bitmap_scan (zused_map, 0, 1, false);
+  if (slot == BITMAP_ERROR)
+    return -1;
+
+  zslots[slot].data = malloc (size);
+  if (zslots[slot].data == NULL)
+    return -1;
+  memcpy (zslots[slot].data, zbuf, size);
+  zslots[slot].size = size;
+  zswap_bytes += size;
+  bitmap_mark (zused_map, slot);
+  return slot;
+}
+
+/* Run-length encodes the page at KPAGE into OUT as (count, byte)
+   pairs.  Returns the encoded size, or 0 if it would exceed MAX
+   bytes.  Cheap, and good enough for the mostly-zero pages that
+   make up most low-entropy swap traffic. */
+static size_t
+compress_page (const uint8_t *kpage, uint8_t *out, size_t max)
+{
+  size_t i = 0, size = 0;
+
+  while (i < PGSIZE)
+    {
+      uint8_t value = kpage[i];
+      size_t run = 1;
+
+      while (i + run < PGSIZE && run < 255 && kpage[i + run] == value)
+        run++;
+      if (size + 2 > max)
+        return 0;
+      out[size++] = run;
+      out[size++] = value;
+      i += run;
+    }
+  return size;
+}
+
+/* Expands SIZE bytes of compress_page() output from IN into the
+   page at KPAGE. */
+static void
+decompress_page (const uint8_t *in, size_t size, uint8_t *kpage)
+{
+  size_t i;
+
+  for (i = 0; i + 1 < size; i += 2)
+    {
+      memset (kpage, in[i + 1], in[i]);
+      kpage += in[i];
+    }
+}
@@ -1,9 +1,17 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+/* Returned by swap_dump_page when every slot is in use. */
+#define SWAP_ERROR (-1)
+
+/* Returned by swap_dump_page for an all-zero page, which is not
+   stored at all. */
+#define SWAP_ZERO (-2)
+
 void swap_init (void);
-int swap_dump_page (void *kpage);
+int swap_dump_page (void *kpage, int hint);
 void swap_load_page (void *kpage, int swap_num);
 void swap_free_page (int swap_num);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */